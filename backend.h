@@ -0,0 +1,110 @@
+/*-
+ * Copyright (c) 2016 Frederic Culot <culot@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "progress.h"
+
+namespace portal {
+
+// Source of the packages catalogues and executor of the transactions
+// Pkg relies upon. The local catalogue lists the installed packages,
+// the remote one those available from the repositories. Ports may be
+// queried from several threads at once, transactions are only run from
+// the thread driving Pkg.
+class Backend {
+ public:
+  enum class Catalogue {
+    local,
+    remote
+  };
+
+  struct Port {
+    std::string             origin;
+    std::string             version;
+    std::string             comment;
+    std::string             description;
+  };
+
+  using Origins = std::vector<std::string>;
+
+  // Pairs of a port and one of its direct dependencies
+  using Edges = std::vector<std::pair<std::string, std::string>>;
+
+  // Pairs of a port and its version
+  using Versions = std::vector<std::pair<std::string, std::string>>;
+
+  // Receives the ports of a catalogue by batches, as soon as they are
+  // read, possibly from several threads at once. Ports can be moved out
+  // of the batch.
+  using Consumer = std::function<void(std::vector<Port>& ports)>;
+
+  // Number of ports handed to a Consumer at once, when streamed
+  static const size_t batchSize = 2048;
+
+  virtual ~Backend() {}
+
+  // All the ports of a catalogue, or only the given origins. Descriptions
+  // are left empty unless asked for.
+  virtual void               getPorts(Catalogue catalogue,
+                                      bool withDescription,
+                                      const Consumer& consumer) = 0;
+  virtual std::vector<Port>  getPorts(Catalogue catalogue,
+                                      const Origins& origins,
+                                      bool withDescription) = 0;
+
+  // Versions of all the ports of a catalogue, much cheaper to read than
+  // the ports themselves, to tell which of them changed.
+  virtual Versions           getVersions(Catalogue catalogue) = 0;
+
+  // Direct dependencies of the given remote ports, and installed ports
+  // directly depending on the given ones.
+  virtual Origins            getDependencies(const Origins& origins) = 0;
+  virtual Origins            getDependents(const Origins& origins) = 0;
+
+  // Direct dependencies of all the ports of a catalogue at once
+  virtual Edges              getDependencyEdges(Catalogue catalogue) = 0;
+
+  // Transactions report their progress as they run, and throw if they
+  // failed, the errors reported being kept in the progress.
+  virtual void               install(const Origins& origins, Progress& progress) = 0;
+  virtual void               remove(const Origins& origins, Progress& progress) = 0;
+  virtual bool               canModify() const = 0;
+
+  // Summary of the state of a catalogue, which changes whenever it does,
+  // and is cheap enough to be polled. Return false if the backend cannot
+  // tell, in which case the catalogues are neither cached nor watched.
+  virtual bool               getFingerprint(Catalogue catalogue,
+                                            uint64_t& fingerprint) const = 0;
+};
+
+}
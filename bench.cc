@@ -0,0 +1,392 @@
+/*-
+ * Copyright (c) 2016 Frederic Culot <culot@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "catalogue.h"
+#include "fixturebackend.h"
+#include "pkg.h"
+#include "pkgbackend.h"
+#include "ui.h"
+
+// Microbenchmarks of the data layer and of the packages list built by
+// the user interface, run over synthetic catalogues. Each catalogue size
+// is measured in its own process, so that the peak RSS reported is its
+// own. Results are printed one per line, with the columns listed in the
+// first line.
+
+static std::atomic<size_t> allocations {0};
+
+void* operator new(size_t size) {
+  ++allocations;
+  void* ptr = malloc(size ? size : 1);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+namespace portal {
+
+static const double minDuration = 0.5;
+static const size_t maxIterations = 1 << 24;
+
+// Runs every operation enough times to last at least minDuration, and
+// reports the averages of the last run.
+class Benchmark {
+ public:
+  Benchmark(const std::string& dir, unsigned int packages)
+    : dir_(dir), packages_(packages) {}
+
+  void run();
+
+ private:
+  std::string   dir_;
+  unsigned int  packages_;
+
+  template <typename Op>
+  void          measure(const char* name, Op op) const;
+  void          reload() const;
+  Ui&           createUi() const;
+};
+
+template <typename Op>
+void Benchmark::measure(const char* name, Op op) const {
+  size_t iterations = 1;
+  for (;;) {
+    size_t allocs = allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+      op();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    allocs = allocations - allocs;
+
+    if (elapsed.count() >= minDuration || iterations >= maxIterations) {
+      struct rusage usage;
+      getrusage(RUSAGE_SELF, &usage);
+      printf("%-16s %9u %10zu %14.1f %11.2f %12ld\n",
+             name,
+             packages_,
+             iterations,
+             elapsed.count() * 1e9 / iterations,
+             static_cast<double>(allocs) / iterations,
+             usage.ru_maxrss);
+      fflush(stdout);
+      return;
+    }
+
+    // Aim a bit past minDuration, without growing too fast from runs
+    // too short to be timed accurately.
+    size_t estimate = iterations * 1.2 * minDuration / std::max(elapsed.count(), 1e-9);
+    iterations = std::min(std::max(iterations * 2, std::min(estimate, iterations * 100)),
+                          maxIterations);
+  }
+}
+
+void Benchmark::reload() const {
+  Pkg::instance().setBackend(std::unique_ptr<Backend>(new FixtureBackend(dir_)));
+  Pkg::instance().reload();
+}
+
+// The interface writes to the terminal when created, so hide it from
+// the results. It is never drawn afterwards.
+Ui& Benchmark::createUi() const {
+  setenv("TERM", "xterm", 1);
+  int out = dup(STDOUT_FILENO);
+  int null = open("/dev/null", O_WRONLY);
+  dup2(null, STDOUT_FILENO);
+  close(null);
+
+  Ui& ui = Ui::instance();
+
+  dup2(out, STDOUT_FILENO);
+  close(out);
+
+  return ui;
+}
+
+void Benchmark::run() {
+  Pkg& pkg = Pkg::instance();
+  pkg.setUseSnapshot(false);
+
+  measure("reload", [this]() {reload();});
+#ifdef WITH_SQLITE
+  // The same catalogue, read from the databases of pkg(8)
+  setenv("PKG_DBDIR", dir_.c_str(), 1);
+  PkgBackend backend;
+  measure("readDatabases", [&backend]() {
+      backend.getPorts(Backend::Catalogue::remote, true, [](std::vector<Backend::Port>&) {});
+      backend.getPorts(Backend::Catalogue::local, true, [](std::vector<Backend::Port>&) {});
+    });
+#endif
+
+  // Size of the descriptions as loaded, and as kept, reported on the
+  // standard error so as not to break the table of measures
+  size_t plainSize = 0;
+  for (Pkg::PkgId id = 0; id < packages_; ++id) {
+    plainSize += pkg.store_.text(id, Pkg::Store::Text::description).length();
+  }
+  fprintf(stderr, "%u packages: descriptions take %zu KiB, %zu KiB as stored\n",
+          packages_, plainSize / 1024, pkg.store_.descriptions().memoryUsage() / 1024);
+
+  Pkg::PkgId id = 0;
+  measure("getPkgAttr", [&]() {
+      pkg.getPkgAttr(id, Pkg::Attr::comment);
+      id = (id + 1) % packages_;
+    });
+  measure("getPkgAttrView", [&]() {
+      pkg.getPkgAttrView(id, Pkg::Attr::comment);
+      id = (id + 1) % packages_;
+    });
+  // Origins are looked up through the hash index, in random order so
+  // that consecutive lookups do not hit neighbouring slots
+  std::vector<std::string> origins;
+  for (Pkg::PkgId i = 0; i < packages_; ++i) {
+    origins.push_back(pkg.store_.text(i, Pkg::Store::Text::origin));
+  }
+  std::shuffle(origins.begin(), origins.end(), std::mt19937(1));
+  size_t origin = 0;
+  measure("getPkgId", [&]() {
+      pkg.getPkgId(origins[origin]);
+      origin = (origin + 1) % origins.size();
+    });
+
+  // The interface reads the dependency graph in the background
+  measure("dependencyGraph", [&]() {
+      pkg.startLoadingGraph();
+      pkg.graphEdges_.wait();
+      pkg.mergeDependencyGraph();
+    });
+  measure("removalImpact", [&]() {
+      pkg.getRemovalImpact(id);
+      id = (id + 1) % packages_;
+    });
+  measure("installImpact", [&]() {
+      pkg.getInstallImpact(id);
+      id = (id + 1) % packages_;
+    });
+
+  Pkg::Status wanted;
+  wanted.set(Pkg::Statuses::installed).set(Pkg::Statuses::upgradable);
+  measure("applyFilter", [&]() {pkg.applyFilter(wanted);});
+  // The search index is built by the first search following a reload.
+  // Words are found in most descriptions, but a pair of them only in a
+  // few names, which the index narrows the search to.
+  pkg.search("daemon-backup");
+  measure("search", [&]() {
+      pkg.searchCache_.clear();
+      pkg.search("daemon-backup");
+    });
+  measure("search-regex", [&]() {
+      pkg.searchCache_.clear();
+      pkg.search("^net.*daemon");
+    });
+  // Typing one more character only looks among the previous matches,
+  // which helps most while the pattern is too short for the index, and
+  // erasing it finds them in the cache
+  measure("search-short", [&]() {
+      pkg.searchCache_.clear();
+      pkg.search("77");
+    });
+  pkg.searchCache_.clear();
+  pkg.search("7");
+  measure("search-narrowed", [&]() {
+      pkg.search("77");
+      pkg.searchCache_.pop_front();
+    });
+  pkg.search("77");
+  measure("search-cached", [&]() {pkg.search("7");});
+  pkg.resetFilter();
+  measure("getPkgOrigins", [&]() {pkg.getPkgOrigins();});
+
+  Ui& ui = createUi();
+  for (const auto& category : pkg.getPkgCategories()) {
+    ui.unfolded_[category] = true;
+  }
+  measure("buildPkgList", [&]() {ui.buildPkgList();});
+  measure("redrawPkgList", [&]() {
+      ui.updatePkgListPane();
+      ui.pane_[Ui::pkgList]->draw();
+    });
+  // The description of the first port of the list
+  ui.pane_[Ui::pkgList]->moveCursorDown();
+  measure("redrawDescrPane", [&]() {
+      ui.updatePkgDescrPane();
+      ui.pane_[Ui::pkgDescr]->draw();
+    });
+  // Marking a port only redraws its row, and folding a category splices
+  // its rows out of the list
+  measure("updatePkgRow", [&]() {
+      ui.pane_[Ui::pkgList]->updateRow(1);
+      ui.pane_[Ui::pkgList]->draw();
+    });
+  measure("toggleCategory", [&]() {
+      ui.toggleCategoryFolding(0);
+      ui.pane_[Ui::pkgList]->draw();
+    });
+}
+
+}
+
+using namespace portal;
+
+void usage(void) {
+  std::cerr << "usage: portal-bench [-d size] [-s skew] [-o directory [-S]] [packages ...]"
+            << std::endl;
+  exit(1);
+}
+
+// Generate a catalogue of the given size in a temporary directory, and
+// measure it in a child process.
+static bool runBenchmark(CatalogueGenerator::Options options) {
+  char dir[] = "/tmp/portal-bench.XXXXXX";
+  if (mkdtemp(dir) == nullptr) {
+    perror("mkdtemp");
+    return false;
+  }
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    try {
+      CatalogueGenerator(options).write(dir);
+#ifdef WITH_SQLITE
+      CatalogueGenerator(options).writeDatabases(dir);
+#endif
+      Benchmark(dir, options.packages).run();
+    }
+    catch (std::exception& e) {
+      std::cerr << e.what() << std::endl;
+      _exit(1);
+    }
+    // Skip the destructors, which would restore a terminal never set up.
+    _exit(0);
+  }
+
+  int status = 0;
+  if (pid < 0 || waitpid(pid, &status, 0) < 0) {
+    perror("fork");
+  }
+  for (const char* name : {"remote", "local", "dependencies", "latency",
+                           "local.sqlite", "repo-portal.sqlite"}) {
+    unlink((std::string(dir) + "/" + name).c_str());
+  }
+  rmdir(dir);
+
+  return pid > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+int main(int argc, char** argv) {
+  CatalogueGenerator::Options options;
+  const char* output = nullptr;
+  bool databases = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "d:o:s:S")) != -1) {
+    switch (opt) {
+    case 'd':
+      options.descriptionSize = atoi(optarg);
+      break;
+    case 'o':
+      output = optarg;
+      break;
+    case 's':
+      options.skew = atof(optarg);
+      break;
+    case 'S':
+      databases = true;
+      break;
+    default:
+      usage();
+    }
+  }
+
+  std::vector<unsigned int> sizes;
+  for (int i = optind; i < argc; ++i) {
+    int size = atoi(argv[i]);
+    if (size < 1) {
+      usage();
+    }
+    sizes.push_back(size);
+  }
+  if (sizes.empty()) {
+    sizes = {1000, 35000, 500000};
+  }
+
+  // Only write the catalogue, to be used with portal -f, or as the
+  // databases of pkg(8) with -S, to be used with PKG_DBDIR
+  if (databases && output == nullptr) {
+    usage();
+  }
+  if (output != nullptr) {
+    options.packages = sizes.front();
+    try {
+      if (databases) {
+        CatalogueGenerator(options).writeDatabases(output);
+      } else {
+        CatalogueGenerator(options).write(output);
+      }
+    }
+    catch (std::exception& e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+
+  printf("%-16s %9s %10s %14s %11s %12s\n",
+         "benchmark", "packages", "iterations", "ns/op", "allocs/op", "peak-rss-kb");
+  fflush(stdout);
+  for (auto size : sizes) {
+    options.packages = size;
+    if (!runBenchmark(options)) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,90 @@
+/*-
+ * Copyright (c) 2016 Frederic Culot <culot@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace portal {
+
+// Packed array of bits. Bits are stored in 64-bit words, so that
+// combining or counting bitmaps is done a word at a time.
+class Bitmap {
+ public:
+  using Word = uint64_t;
+
+  static const size_t wordBits = 64;
+
+  size_t  size() const {return size_;}
+  void    clear() {words_.clear(); size_ = 0;}
+  void    reset() {words_.assign(words_.size(), 0);}
+
+  // Bits added when growing the bitmap are cleared
+  void    resize(size_t size) {
+    words_.resize((size + wordBits - 1) / wordBits, 0);
+    size_ = size;
+  }
+
+  bool    test(size_t bit) const {return words_[bit / wordBits] & mask(bit);}
+  void    set(size_t bit) {words_[bit / wordBits] |= mask(bit);}
+  void    reset(size_t bit) {words_[bit / wordBits] &= ~mask(bit);}
+  void    set(size_t bit, bool value) {value ? set(bit) : reset(bit);}
+
+  size_t  count() const {
+    size_t count = 0;
+    for (const auto& word : words_) {
+      count += __builtin_popcountll(word);
+    }
+    return count;
+  }
+
+  Bitmap& operator|=(const Bitmap& other) {
+    for (size_t i = 0; i < words_.size() && i < other.words_.size(); ++i) {
+      words_[i] |= other.words_[i];
+    }
+    return *this;
+  }
+
+  // Call f with the index of every set bit, in increasing order
+  template <typename F>
+  void    forEach(F f) const {
+    for (size_t i = 0; i < words_.size(); ++i) {
+      for (Word word = words_[i]; word != 0; word &= word - 1) {
+        f(i * wordBits + __builtin_ctzll(word));
+      }
+    }
+  }
+
+ private:
+  std::vector<Word>  words_;
+  size_t             size_ {0};
+
+  static Word  mask(size_t bit) {return Word(1) << (bit % wordBits);}
+};
+
+}
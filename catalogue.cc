@@ -0,0 +1,361 @@
+/*-
+ * Copyright (c) 2016 Frederic Culot <culot@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <unistd.h>
+#ifdef WITH_SQLITE
+#include <sqlite3.h>
+#endif
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "catalogue.h"
+
+namespace portal {
+
+static const char delimiter = '\2';
+
+static const std::vector<std::string> categoryNames {
+  "accessibility", "archivers", "astro", "audio", "benchmarks", "biology",
+  "cad", "comms", "converters", "databases", "deskutils", "devel", "dns",
+  "editors", "emulators", "finance", "ftp", "games", "graphics", "irc",
+  "java", "lang", "mail", "math", "misc", "multimedia", "net", "net-im",
+  "net-mgmt", "news", "print", "science", "security", "shells", "sysutils",
+  "textproc", "www", "x11", "x11-fonts", "x11-toolkits", "x11-wm"
+};
+
+static const std::vector<std::string> words {
+  "audio", "network", "library", "graphics", "server", "client", "toolkit",
+  "parser", "daemon", "utility", "compiler", "python", "perl", "ruby", "data",
+  "text", "image", "video", "secure", "fast", "simple", "portable", "modular",
+  "terminal", "editor", "shell", "font", "game", "database", "web", "mail",
+  "archive", "crypto", "stream", "markup", "driver", "monitor", "backup"
+};
+
+using FilePtr = std::unique_ptr<FILE, int (*)(FILE*)>;
+
+static FilePtr create(const std::string& path) {
+  FilePtr fp(fopen(path.c_str(), "w"), fclose);
+  if (!fp) {
+    throw std::runtime_error("CatalogueGenerator::write(): could not create [" + path + "]");
+  }
+
+  return fp;
+}
+
+static void writeRecord(FILE* fp, const CatalogueGenerator::Port& port) {
+  for (const auto* field : {&port.origin, &port.version, &port.comment, &port.description}) {
+    fwrite(field->data(), 1, field->length(), fp);
+    fputc(delimiter, fp);
+  }
+  fputc('\n', fp);
+}
+
+void CatalogueGenerator::write(const std::string& dir) const {
+  FilePtr remote = create(dir + "/remote");
+  FilePtr local = create(dir + "/local");
+  FilePtr dependencies = create(dir + "/dependencies");
+  FilePtr latency = create(dir + "/latency");
+  fputs("0\n", latency.get());
+
+  generate([&](const Port& remotePort,
+               const Port* localPort,
+               const std::vector<std::string>& origins) {
+      writeRecord(remote.get(), remotePort);
+      if (localPort != nullptr) {
+        writeRecord(local.get(), *localPort);
+      }
+      for (const auto& origin : origins) {
+        fprintf(dependencies.get(), "%s %s\n", remotePort.origin.c_str(), origin.c_str());
+      }
+    });
+}
+
+#ifdef WITH_SQLITE
+// Tables of the databases read by PkgBackend, as created by pkg(8): the
+// packages and their dependencies, with all the columns pkg(8) itself
+// requires. The local database is local.sqlite, and the catalogue of
+// the single remote repository is repo-portal.sqlite.
+static const char localSchema[] =
+  "CREATE TABLE packages ("
+  " id INTEGER PRIMARY KEY, origin TEXT NOT NULL, name TEXT NOT NULL,"
+  " version TEXT NOT NULL, comment TEXT NOT NULL, desc TEXT NOT NULL,"
+  " mtree_id INTEGER, message TEXT, arch TEXT NOT NULL, maintainer TEXT NOT NULL,"
+  " www TEXT, prefix TEXT NOT NULL, flatsize INTEGER NOT NULL,"
+  " automatic INTEGER NOT NULL, locked INTEGER NOT NULL DEFAULT 0,"
+  " licenselogic INTEGER NOT NULL, time INTEGER, manifestdigest TEXT NULL,"
+  " pkg_format_version INTEGER, dep_formula TEXT NULL,"
+  " vital INTEGER NOT NULL DEFAULT 0);"
+  "CREATE UNIQUE INDEX packages_unique ON packages(name);"
+  "CREATE INDEX packages_origin ON packages(origin COLLATE NOCASE);"
+  "CREATE TABLE deps ("
+  " origin TEXT NOT NULL, name TEXT NOT NULL, version TEXT NOT NULL,"
+  " package_id INTEGER REFERENCES packages(id) ON DELETE CASCADE ON UPDATE CASCADE,"
+  " UNIQUE(package_id, name));";
+
+static const char remoteSchema[] =
+  "CREATE TABLE packages ("
+  " id INTEGER PRIMARY KEY, origin TEXT, name TEXT NOT NULL,"
+  " version TEXT NOT NULL, comment TEXT NOT NULL, desc TEXT NOT NULL,"
+  " osversion TEXT, arch TEXT NOT NULL, maintainer TEXT NOT NULL, www TEXT,"
+  " prefix TEXT NOT NULL, pkgsize INTEGER NOT NULL, flatsize INTEGER NOT NULL,"
+  " licenselogic INTEGER NOT NULL, cksum TEXT NOT NULL, path TEXT NOT NULL,"
+  " pkg_format_version INTEGER, manifestdigest TEXT NULL, olddigest TEXT NULL,"
+  " dep_formula TEXT NULL, vital INTEGER NOT NULL DEFAULT 0);"
+  "CREATE INDEX packages_origin ON packages(origin COLLATE NOCASE);"
+  "CREATE TABLE deps ("
+  " origin TEXT, name TEXT, version TEXT,"
+  " package_id INTEGER REFERENCES packages(id) ON DELETE CASCADE ON UPDATE CASCADE,"
+  " UNIQUE(package_id, origin));";
+
+static const char localInsert[] =
+  "INSERT INTO packages (origin, name, version, comment, desc, arch, maintainer,"
+  " www, prefix, flatsize, automatic, licenselogic, time)"
+  " VALUES (?1, ?2, ?3, ?4, ?5, 'FreeBSD:14:amd64', 'ports@FreeBSD.org',"
+  " 'https://www.example.org/', '/usr/local', 1048576, 0, 1, 0)";
+
+static const char remoteInsert[] =
+  "INSERT INTO packages (origin, name, version, comment, desc, arch, maintainer,"
+  " www, prefix, pkgsize, flatsize, licenselogic, cksum, path)"
+  " VALUES (?1, ?2, ?3, ?4, ?5, 'FreeBSD:14:amd64', 'ports@FreeBSD.org',"
+  " 'https://www.example.org/', '/usr/local', 262144, 1048576, 1, '',"
+  " 'All/' || ?2 || '-' || ?3 || '.pkg')";
+
+static const char dependencyInsert[] =
+  "INSERT OR IGNORE INTO deps (origin, name, version, package_id) VALUES (?1, ?2, ?3, ?4)";
+
+static std::string getName(const std::string& origin) {
+  return origin.substr(origin.find('/') + 1);
+}
+
+// A database being written, with the statements inserting the packages
+// and their dependencies. Everything is written in a single transaction.
+class Database {
+ public:
+  Database(const std::string& path, const char* schema, const char* insert)
+    : path_(path) {
+    unlink(path.c_str());
+    if (sqlite3_open(path.c_str(), &db_) != SQLITE_OK) {
+      sqlite3_close(db_);
+      db_ = nullptr;
+      fail("could not create");
+    }
+    if (sqlite3_exec(db_, schema, nullptr, nullptr, nullptr) != SQLITE_OK
+        || sqlite3_exec(db_, "BEGIN", nullptr, nullptr, nullptr) != SQLITE_OK
+        || sqlite3_prepare_v2(db_, insert, -1, &insert_, nullptr) != SQLITE_OK
+        || sqlite3_prepare_v2(db_, dependencyInsert, -1, &dependency_, nullptr) != SQLITE_OK) {
+      fail("could not initialize");
+    }
+  }
+
+  ~Database() {
+    sqlite3_finalize(insert_);
+    sqlite3_finalize(dependency_);
+    sqlite3_close(db_);
+  }
+
+  Database(const Database&) = delete;
+  void operator=(const Database&) = delete;
+
+  void insert(const CatalogueGenerator::Port& port) {
+    std::string name = getName(port.origin);
+    sqlite3_bind_text(insert_, 1, port.origin.data(), port.origin.length(), SQLITE_TRANSIENT);
+    sqlite3_bind_text(insert_, 2, name.data(), name.length(), SQLITE_TRANSIENT);
+    sqlite3_bind_text(insert_, 3, port.version.data(), port.version.length(), SQLITE_TRANSIENT);
+    sqlite3_bind_text(insert_, 4, port.comment.data(), port.comment.length(), SQLITE_TRANSIENT);
+    sqlite3_bind_text(insert_, 5, port.description.data(), port.description.length(),
+                      SQLITE_TRANSIENT);
+    step(insert_);
+  }
+
+  // Dependencies of the last inserted port, given the versions of the
+  // remote ports
+  void insertDependencies(const std::vector<std::string>& origins,
+                          const std::unordered_map<std::string, std::string>& versions) {
+    sqlite3_int64 id = sqlite3_last_insert_rowid(db_);
+    for (const auto& origin : origins) {
+      std::string name = getName(origin);
+      const std::string& version = versions.at(origin);
+      sqlite3_bind_text(dependency_, 1, origin.data(), origin.length(), SQLITE_TRANSIENT);
+      sqlite3_bind_text(dependency_, 2, name.data(), name.length(), SQLITE_TRANSIENT);
+      sqlite3_bind_text(dependency_, 3, version.data(), version.length(), SQLITE_TRANSIENT);
+      sqlite3_bind_int64(dependency_, 4, id);
+      step(dependency_);
+    }
+  }
+
+  void commit() {
+    if (sqlite3_exec(db_, "COMMIT", nullptr, nullptr, nullptr) != SQLITE_OK) {
+      fail("could not write");
+    }
+  }
+
+ private:
+  std::string    path_;
+  sqlite3*       db_ {nullptr};
+  sqlite3_stmt*  insert_ {nullptr};
+  sqlite3_stmt*  dependency_ {nullptr};
+
+  void step(sqlite3_stmt* stmt) {
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+      fail("could not insert into");
+    }
+    sqlite3_reset(stmt);
+  }
+
+  [[noreturn]] void fail(const std::string& what) {
+    std::string error = db_ != nullptr ? std::string(": ") + sqlite3_errmsg(db_) : "";
+    throw std::runtime_error("CatalogueGenerator::writeDatabases(): " + what
+                             + " [" + path_ + "]" + error);
+  }
+};
+#endif
+
+// The same ports as write(), to be read with PKG_DBDIR set to dir
+void CatalogueGenerator::writeDatabases(const std::string& dir) const {
+#ifdef WITH_SQLITE
+  Database remote(dir + "/repo-portal.sqlite", remoteSchema, remoteInsert);
+  Database local(dir + "/local.sqlite", localSchema, localInsert);
+  std::unordered_map<std::string, std::string> versions;
+
+  generate([&](const Port& remotePort,
+               const Port* localPort,
+               const std::vector<std::string>& origins) {
+      versions.emplace(remotePort.origin, remotePort.version);
+      remote.insert(remotePort);
+      remote.insertDependencies(origins, versions);
+      if (localPort != nullptr) {
+        local.insert(*localPort);
+        local.insertDependencies(origins, versions);
+      }
+    });
+  remote.commit();
+  local.commit();
+#else
+  throw std::runtime_error("CatalogueGenerator::writeDatabases(): built without SQLite support");
+#endif
+}
+
+void CatalogueGenerator::generate(const PortConsumer& consumer) const {
+  std::mt19937 rng(options_.seed);
+  auto pick = [&rng](const std::vector<std::string>& list) -> const std::string& {
+    return list[std::uniform_int_distribution<size_t>(0, list.size() - 1)(rng)];
+  };
+  auto chance = [&rng](double probability) {
+    return std::uniform_real_distribution<double>(0, 1)(rng) < probability;
+  };
+  auto number = [&rng](unsigned int max) {
+    return std::uniform_int_distribution<unsigned int>(0, max)(rng);
+  };
+
+  std::vector<std::string> categories;
+  std::vector<double> weights;
+  for (unsigned int i = 0; i < options_.categories; ++i) {
+    std::string name = categoryNames[i % categoryNames.size()];
+    if (i >= categoryNames.size()) {
+      name += std::to_string(i / categoryNames.size());
+    }
+    categories.push_back(name);
+    weights.push_back(1.0 / std::pow(i + 1, options_.skew));
+  }
+  std::discrete_distribution<unsigned int> category(weights.begin(), weights.end());
+
+  std::vector<std::string> origins;
+  origins.reserve(options_.packages);
+  std::string baseName, baseDescription;
+  Port remote, local;
+  std::vector<std::string> dependencies;
+  for (unsigned int i = 0; i < options_.packages; ++i) {
+    // Flavours of a port, such as py39-foo and py311-foo, carry the
+    // same description.
+    bool flavour = !baseName.empty() && chance(options_.flavourRatio);
+    std::string name = flavour ? "py3" + std::to_string(9 + number(3)) + "-" + baseName
+                                 + std::to_string(i)
+                               : pick(words) + "-" + pick(words) + std::to_string(i);
+    std::string origin = categories[category(rng)] + "/" + name;
+
+    unsigned int major = number(20), minor = number(30);
+    std::string version = std::to_string(major) + "." + std::to_string(minor);
+    if (chance(0.5)) {
+      version += "." + std::to_string(number(15));
+    }
+    std::string revision = chance(0.3) ? "_" + std::to_string(1 + number(5)) : "";
+
+    std::string comment = pick(words);
+    comment[0] = toupper(comment[0]);
+    for (unsigned int n = 2 + number(4); n > 0; --n) {
+      comment += " " + pick(words);
+    }
+
+    std::string description = baseDescription;
+    if (!flavour) {
+      description.clear();
+      size_t lineStart = 0;
+      while (description.length() < options_.descriptionSize) {
+        if (description.length() - lineStart > 70) {
+          description += "\n";
+          lineStart = description.length();
+        } else if (!description.empty()) {
+          description += " ";
+        }
+        description += pick(words);
+      }
+      description += "\n\nWWW: https://www.example.org/" + name + "/\n";
+      baseName = name.substr(0, name.find('-'));
+      baseDescription = description;
+    }
+
+    remote = {origin, version + revision, comment, description};
+
+    // Installed ports are mostly up to date, some are older and a few
+    // were built locally with a newer revision.
+    bool installed = chance(options_.installedRatio);
+    if (installed) {
+      local = remote;
+      if (chance(0.2)) {
+        local.version = minor ? std::to_string(major) + "." + std::to_string(minor - 1)
+                              : "0." + version;
+      } else if (chance(0.1)) {
+        local.version = version + "_9";
+      }
+    }
+
+    // Dependencies only point to previous ports, which keeps the graph
+    // acyclic as the ports one is.
+    dependencies.clear();
+    for (unsigned int n = i ? number(3) : 0; n > 0; --n) {
+      dependencies.push_back(origins[number(i - 1)]);
+    }
+    consumer(remote, installed ? &local : nullptr, dependencies);
+    origins.push_back(std::move(origin));
+  }
+}
+
+}
@@ -0,0 +1,77 @@
+/*-
+ * Copyright (c) 2016 Frederic Culot <culot@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace portal {
+
+// Generator of synthetic catalogues, written in the format read by
+// FixtureBackend, or as the SQLite databases of pkg(8) read by
+// PkgBackend when built with WITH_SQLITE. Ports are spread over the
+// categories following a Zipf distribution, so that a few categories
+// hold most of them as in the ports tree. The same options always
+// produce the same catalogue.
+class CatalogueGenerator {
+ public:
+  struct Options {
+    unsigned int  packages {35000};
+    unsigned int  categories {60};
+    double        skew {1.0};          // Zipf exponent of the category sizes
+    unsigned int  descriptionSize {400};
+    double        flavourRatio {0.3};  // ports sharing the description of the previous one
+    double        installedRatio {0.15};
+    unsigned int  seed {1};
+  };
+
+  struct Port {
+    std::string  origin;
+    std::string  version;
+    std::string  comment;
+    std::string  description;
+  };
+
+  explicit CatalogueGenerator(const Options& options) : options_(options) {}
+
+  void  write(const std::string& dir) const;
+  void  writeDatabases(const std::string& dir) const;
+
+ private:
+  // Called for each port with its remote record, its local one if it
+  // is installed, and the origins it depends on
+  using PortConsumer = std::function<void(const Port& remote,
+                                          const Port* local,
+                                          const std::vector<std::string>& dependencies)>;
+
+  Options  options_;
+
+  void  generate(const PortConsumer& consumer) const;
+};
+
+}
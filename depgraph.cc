@@ -0,0 +1,119 @@
+/*-
+ * Copyright (c) 2016 Frederic Culot <culot@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+
+#include "bitmap.h"
+#include "depgraph.h"
+
+namespace portal {
+
+void DependencyGraph::clear() {
+  numNodes_ = 0;
+  forward_ = Rows();
+  reverse_ = Rows();
+}
+
+// Edges referring to nodes out of range are ignored
+void DependencyGraph::build(size_t numNodes, const std::vector<Edge>& edges) {
+  numNodes_ = numNodes;
+  forward_.build(numNodes, edges, false);
+  reverse_.build(numNodes, edges, true);
+}
+
+// Nodes reachable from the roots in the given direction, roots excluded,
+// in breadth-first order. If given, follow() tells whether a node is to
+// be reported and its own edges followed.
+std::vector<DependencyGraph::Node> DependencyGraph::closure(const std::vector<Node>& roots,
+                                                           Direction direction,
+                                                           const std::function<bool(Node)>& follow) const {
+  const Rows& rows = direction == Direction::dependencies ? forward_ : reverse_;
+  Bitmap visited;
+  visited.resize(numNodes_);
+  std::vector<Node> reached;
+
+  for (const auto& root : roots) {
+    if (root < numNodes_) {
+      visited.set(root);
+    }
+  }
+  std::vector<Node> frontier(roots);
+  size_t next = 0;
+  while (next < frontier.size()) {
+    for (const auto& node : rows.row(frontier[next++], numNodes_)) {
+      if (visited.test(node)) {
+        continue;
+      }
+      visited.set(node);
+      if (follow && !follow(node)) {
+        continue;
+      }
+      reached.push_back(node);
+      frontier.push_back(node);
+    }
+  }
+
+  return reached;
+}
+
+// Counting sort of the edges by source, or by target when reversed. Each
+// row is sorted, and duplicate edges are kept as they are harmless.
+void DependencyGraph::Rows::build(size_t numNodes, const std::vector<Edge>& edges, bool reversed) {
+  offsets.assign(numNodes + 1, 0);
+  for (const auto& edge : edges) {
+    Node from = reversed ? edge.second : edge.first;
+    Node to = reversed ? edge.first : edge.second;
+    if (from < numNodes && to < numNodes) {
+      ++offsets[from + 1];
+    }
+  }
+  for (size_t node = 0; node < numNodes; ++node) {
+    offsets[node + 1] += offsets[node];
+  }
+
+  targets.resize(offsets[numNodes]);
+  std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+  for (const auto& edge : edges) {
+    Node from = reversed ? edge.second : edge.first;
+    Node to = reversed ? edge.first : edge.second;
+    if (from < numNodes && to < numNodes) {
+      targets[fill[from]++] = to;
+    }
+  }
+  for (size_t node = 0; node < numNodes; ++node) {
+    std::sort(targets.begin() + offsets[node], targets.begin() + offsets[node + 1]);
+  }
+}
+
+DependencyGraph::Range DependencyGraph::Rows::row(Node node, size_t numNodes) const {
+  if (node >= numNodes) {
+    return Range(nullptr, nullptr);
+  }
+
+  return Range(targets.data() + offsets[node], targets.data() + offsets[node + 1]);
+}
+
+}
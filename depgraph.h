@@ -0,0 +1,91 @@
+/*-
+ * Copyright (c) 2016 Frederic Culot <culot@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace portal {
+
+// Dependencies between ports, kept in compressed sparse row form: the
+// direct dependencies of a node are the slice of targets starting at its
+// offset and ending at the offset of the next node. Reverse edges are
+// kept the same way, to list the dependents of a node. Nodes are the
+// identifiers of the ports, and the graph is rebuilt as a whole whenever
+// the edges change.
+class DependencyGraph {
+ public:
+  using Node = unsigned int;
+  using Edge = std::pair<Node, Node>;   // port, and one of its dependencies
+
+  enum class Direction {
+    dependencies,
+    dependents
+  };
+
+  class Range {
+   public:
+    Range(const Node* begin, const Node* end) : begin_(begin), end_(end) {}
+
+    const Node*  begin() const {return begin_;}
+    const Node*  end() const {return end_;}
+    size_t       size() const {return end_ - begin_;}
+
+   private:
+    const Node*  begin_;
+    const Node*  end_;
+  };
+
+  bool               empty() const {return forward_.targets.empty();}
+  size_t             numNodes() const {return numNodes_;}
+  size_t             numEdges() const {return forward_.targets.size();}
+  void               clear();
+  void               build(size_t numNodes, const std::vector<Edge>& edges);
+  Range              dependencies(Node node) const {return forward_.row(node, numNodes_);}
+  Range              dependents(Node node) const {return reverse_.row(node, numNodes_);}
+  std::vector<Node>  closure(const std::vector<Node>& roots,
+                             Direction direction,
+                             const std::function<bool(Node)>& follow = nullptr) const;
+
+ private:
+  struct Rows {
+    std::vector<uint32_t>  offsets;
+    std::vector<Node>      targets;
+
+    void   build(size_t numNodes, const std::vector<Edge>& edges, bool reversed);
+    Range  row(Node node, size_t numNodes) const;
+  };
+
+  size_t  numNodes_ {0};
+  Rows    forward_;
+  Rows    reverse_;
+};
+
+}
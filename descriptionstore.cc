@@ -0,0 +1,210 @@
+/*-
+ * Copyright (c) 2016 Frederic Culot <culot@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <zlib.h>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include "hash.h"
+#include "descriptionstore.h"
+
+namespace portal {
+
+// Size of the blocks before compression, and number of blocks kept
+// decompressed
+static const size_t blockSize = 32 * 1024;
+static const size_t cachedBlocks = 8;
+
+void DescriptionStore::clear() {
+  entries_.clear();
+  blocks_.clear();
+  compressed_.clear();
+  open_.clear();
+  index_.clear();
+  std::lock_guard<std::mutex> lock(cacheMutex_);
+  cache_.clear();
+}
+
+// Identical descriptions are told apart by a 64-bit hash of their
+// contents, which makes collisions unlikely enough among a few hundred
+// thousand ports to be ignored.
+DescriptionStore::Handle DescriptionStore::add(const char* text, size_t len) {
+  uint64_t hash = fnv1a(text, len);
+  hash = fnv1a(&len, sizeof(len), hash);
+  auto it = index_.find(hash);
+  if (it != index_.end()) {
+    return it->second;
+  }
+
+  if (!open_.empty() && open_.size() + len > blockSize) {
+    flush();
+  }
+  Entry entry;
+  entry.hash = hash;
+  entry.block = blocks_.size();
+  entry.offset = open_.size();
+  entry.length = len;
+  open_.append(text, len);
+
+  Handle handle = entries_.size();
+  entries_.push_back(entry);
+  index_.emplace(hash, handle);
+
+  return handle;
+}
+
+std::string DescriptionStore::get(Handle handle) const {
+  const Entry& entry = entries_.at(handle);
+  if (entry.block == blocks_.size()) {
+    return open_.substr(entry.offset, entry.length);
+  }
+
+  std::lock_guard<std::mutex> lock(cacheMutex_);
+  return getBlock(entry.block).substr(entry.offset, entry.length);
+}
+
+// Compress the block being filled, if any
+void DescriptionStore::flush() {
+  if (open_.empty()) {
+    return;
+  }
+
+  uLongf len = compressBound(open_.size());
+  std::vector<char> buf(len);
+  if (compress2(reinterpret_cast<Bytef*>(buf.data()), &len,
+                reinterpret_cast<const Bytef*>(open_.data()), open_.size(),
+                Z_BEST_SPEED) != Z_OK) {
+    throw std::runtime_error("DescriptionStore::flush(): could not compress block");
+  }
+
+  Block block;
+  block.data = compressed_.append(buf.data(), len);
+  block.rawSize = open_.size();
+  blocks_.push_back(block);
+  open_.clear();
+}
+
+// Approximate number of bytes held, hash table nodes included
+size_t DescriptionStore::memoryUsage() const {
+  size_t usage = entries_.capacity() * sizeof(Entry)
+    + blocks_.capacity() * sizeof(Block)
+    + compressed_.size()
+    + open_.capacity()
+    + index_.size() * (sizeof(std::pair<uint64_t, Handle>) + 2 * sizeof(void*))
+    + index_.bucket_count() * sizeof(void*);
+
+  std::lock_guard<std::mutex> lock(cacheMutex_);
+  for (const auto& cached : cache_) {
+    usage += sizeof(cached) + cached.data.capacity();
+  }
+
+  return usage;
+}
+
+// The block being filled must have been flushed
+bool DescriptionStore::write(FILE* fp) const {
+  if (!open_.empty()) {
+    throw std::logic_error("DescriptionStore::write(): store was not flushed");
+  }
+
+  return fwrite(entries_.data(), sizeof(Entry), entries_.size(), fp) == entries_.size()
+    && fwrite(blocks_.data(), sizeof(Block), blocks_.size(), fp) == blocks_.size()
+    && compressed_.write(fp);
+}
+
+// Entries and blocks are copied, compressed blocks stay where they are.
+// Return false, leaving the store empty, if they do not hold together.
+bool DescriptionStore::borrow(const char* data,
+                              size_t numEntries,
+                              size_t numBlocks,
+                              size_t compressedSize) {
+  clear();
+  entries_.resize(numEntries);
+  memcpy(entries_.data(), data, numEntries * sizeof(Entry));
+  data += numEntries * sizeof(Entry);
+  blocks_.resize(numBlocks);
+  memcpy(blocks_.data(), data, numBlocks * sizeof(Block));
+  data += numBlocks * sizeof(Block);
+  compressed_.borrow(data, compressedSize);
+
+  bool valid = true;
+  for (const auto& block : blocks_) {
+    valid = valid && static_cast<uint64_t>(block.data.offset) + block.data.length <= compressedSize;
+  }
+  for (const auto& entry : entries_) {
+    valid = valid && entry.block < blocks_.size()
+      && static_cast<uint64_t>(entry.offset) + entry.length <= blocks_[entry.block].rawSize;
+  }
+  if (!valid) {
+    clear();
+    return false;
+  }
+
+  for (Handle handle = 0; handle < entries_.size(); ++handle) {
+    index_.emplace(entries_[handle].hash, handle);
+  }
+
+  return true;
+}
+
+// Return the decompressed block, replacing the least recently used one
+// if it is not cached already. cacheMutex_ must be held.
+const std::string& DescriptionStore::getBlock(uint32_t index) const {
+  ++uses_;
+  for (auto& cached : cache_) {
+    if (cached.block == index) {
+      cached.lastUse = uses_;
+      return cached.data;
+    }
+  }
+
+  const Block& block = blocks_[index];
+  std::string data(block.rawSize, '\0');
+  uLongf len = block.rawSize;
+  if (uncompress(reinterpret_cast<Bytef*>(&data[0]), &len,
+                 reinterpret_cast<const Bytef*>(compressed_.data(block.data)),
+                 block.data.length) != Z_OK || len != block.rawSize) {
+    throw std::runtime_error("DescriptionStore::getBlock(): corrupted block ["
+                             + std::to_string(index) + "]");
+  }
+
+  if (cache_.size() < cachedBlocks) {
+    cache_.push_back({index, uses_, std::move(data)});
+    return cache_.back().data;
+  }
+  auto victim = std::min_element(cache_.begin(), cache_.end(),
+                                 [](const CachedBlock& lhs, const CachedBlock& rhs) {
+                                   return lhs.lastUse < rhs.lastUse;
+                                 });
+  victim->block = index;
+  victim->lastUse = uses_;
+  victim->data = std::move(data);
+
+  return victim->data;
+}
+
+}
@@ -0,0 +1,96 @@
+/*-
+ * Copyright (c) 2016 Frederic Culot <culot@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "textarena.h"
+
+namespace portal {
+
+// Descriptions of the ports, each distinct one stored once and grouped
+// with others into blocks compressed with zlib. Flavours of a port share
+// the same description, and descriptions are mostly plain English, so
+// both deduplication and compression pay off. The block being filled is
+// kept uncompressed until it is full, and a few blocks are kept
+// decompressed, the most recently used ones, as neighbouring ports tend
+// to be read together. Compressed blocks live in a TextArena, hence can
+// be borrowed from a mapped snapshot.
+class DescriptionStore {
+ public:
+  using Handle = uint32_t;
+
+  // Entries and blocks are written to snapshots as they are
+  struct Entry {
+    uint64_t  hash;
+    uint32_t  block;
+    uint32_t  offset;
+    uint32_t  length;
+    uint32_t  padding {0};
+  };
+
+  struct Block {
+    TextArena::Ref  data;
+    uint32_t        rawSize;
+  };
+
+  void         clear();
+  Handle       add(const char* text, size_t len);
+  std::string  get(Handle handle) const;
+  void         flush();
+  size_t       numEntries() const {return entries_.size();}
+  size_t       numBlocks() const {return blocks_.size();}
+  size_t       compressedSize() const {return compressed_.size();}
+  size_t       memoryUsage() const;
+  bool         write(FILE* fp) const;
+  bool         borrow(const char* data, size_t numEntries, size_t numBlocks, size_t compressedSize);
+
+ private:
+  struct CachedBlock {
+    uint32_t     block;
+    uint64_t     lastUse;
+    std::string  data;
+  };
+
+  std::vector<Entry>                     entries_;
+  std::vector<Block>                     blocks_;
+  TextArena                              compressed_;
+  std::string                            open_;    // block being filled
+  std::unordered_map<uint64_t, Handle>   index_;   // by hash of the contents
+  mutable std::mutex                     cacheMutex_;
+  mutable std::vector<CachedBlock>       cache_;
+  mutable uint64_t                       uses_ {0};
+
+  const std::string&  getBlock(uint32_t block) const;
+};
+
+}
@@ -32,58 +32,83 @@ namespace portal {
 
 static constexpr int ctrl(int c) {return 0x1F & c;}
 
-bool Event::poll() {
+// Wait for a key press, or for timeoutMs milliseconds at most if not
+// negative, in which case a tick event is returned on expiry. A movement
+// key is folded together with the same keys already waiting behind it,
+// count() telling how many times it was pressed.
+bool Event::poll(int timeoutMs) {
+  timeout(timeoutMs);
   character_ = getch();
-  switch (character_) {
+  type_ = typeOf(character_);
+  count_ = 1;
+
+  if (isMovement(type_)) {
+    timeout(0);
+    for (int next = getch(); next != ERR; next = getch()) {
+      if (typeOf(next) != type_) {
+        ungetch(next);
+        break;
+      }
+      ++count_;
+    }
+  }
+
+  return type_ != Type::quit;
+}
+
+// Tell whether a key press is waiting to be read, without consuming it
+bool Event::isPending() {
+  timeout(0);
+  int next = getch();
+  if (next == ERR) {
+    return false;
+  }
+  ungetch(next);
+
+  return true;
+}
+
+Event::Type Event::typeOf(int character) {
+  switch (character) {
+  case ERR:
+    return Type::tick;
   case '\t':
-    type_ = Type::nextMode;
-    break;
+    return Type::nextMode;
   case ctrl('X'):
-    type_ = Type::go;
-    break;
+    return Type::go;
   case ctrl('N'):
-    type_ = Type::keyDown;
-    break;
+    return Type::keyDown;
   case ctrl('P'):
-    type_ = Type::keyUp;
-    break;
+    return Type::keyUp;
   case ctrl('C'):
-    type_ = Type::quit;
-    break;
+    return Type::quit;
   case ctrl(' '):
-    type_ = Type::select;
-    break;
+    return Type::select;
   case ctrl('D'):
-    type_ = Type::deselect;
-    break;
+    return Type::deselect;
   case KEY_BACKSPACE:
-    type_ = Type::keyBackspace;
-    break;
+    return Type::keyBackspace;
   case KEY_DOWN:
-    type_ = Type::keyDown;
-    break;
+    return Type::keyDown;
   case KEY_UP:
-    type_ = Type::keyUp;
-    break;
+    return Type::keyUp;
   case KEY_PPAGE:
-    type_ = Type::pageUp;
-    break;
+    return Type::pageUp;
   case KEY_NPAGE:
-    type_ = Type::pageDown;
-    break;
+    return Type::pageDown;
   case KEY_ENTER:
   case '\n':
-    type_ = Type::enter;
-    break;
+    return Type::enter;
   case ctrl('L'):
-    type_ = Type::redraw;
-    break;
+    return Type::redraw;
   default:
-    type_ = Type::character;
-    break;
+    return Type::character;
   }
+}
 
-  return type_ != Type::quit;
+bool Event::isMovement(Type type) {
+  return type == Type::keyDown || type == Type::keyUp
+    || type == Type::pageDown || type == Type::pageUp;
 }
 
 }
@@ -47,16 +47,24 @@ class Event {
     redraw,
     pageDown,
     pageUp,
+    tick,
     quit
   };
 
   Type  type() const {return type_;}
   int   character() const {return character_;}
-  bool  poll();
+  int   count() const {return count_;}
+  bool  poll(int timeoutMs = -1);
+
+  static bool  isPending();
 
  private:
   Type type_ {Type::unknown};
   int  character_;
+  int  count_ {1};
+
+  static Type  typeOf(int character);
+  static bool  isMovement(Type type);
 };
 
 }
@@ -0,0 +1,336 @@
+/*-
+ * Copyright (c) 2016 Frederic Culot <culot@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <chrono>
+#include <set>
+
+#include "parser.h"
+#include "fixturebackend.h"
+
+namespace portal {
+
+static const char delimiter = '\2';
+
+static Backend::Port withoutDescription(const Backend::Port& port) {
+  Backend::Port copy;
+  copy.origin = port.origin;
+  copy.version = port.version;
+  copy.comment = port.comment;
+
+  return copy;
+}
+
+FixtureBackend::FixtureBackend(const std::string& dir)
+  : dir_(dir) {
+  for (auto catalogue : {Catalogue::remote, Catalogue::local}) {
+    std::string path = getPath(catalogue);
+    if (access(path.c_str(), R_OK) != 0) {
+      throw std::runtime_error("FixtureBackend::FixtureBackend(): could not read [" + path + "]");
+    }
+  }
+
+  std::ifstream latency(dir + "/latency");
+  if (latency) {
+    latency >> latency_;
+  }
+}
+
+void FixtureBackend::getPorts(Catalogue catalogue,
+                              bool withDescription,
+                              const Consumer& consumer) {
+  Contents& contents = getContents(catalogue);
+  std::lock_guard<std::mutex> lock(contents.mutex);
+  if (!contents.loaded) {
+    readPorts(catalogue, withDescription, &consumer);
+    return;
+  }
+
+  std::vector<Port> batch;
+  for (const auto& port : contents.ports) {
+    batch.push_back(withDescription ? port.second : withoutDescription(port.second));
+    if (batch.size() == batchSize) {
+      consumer(batch);
+      batch.clear();
+    }
+  }
+  if (!batch.empty()) {
+    consumer(batch);
+  }
+}
+
+std::vector<Backend::Port> FixtureBackend::getPorts(Catalogue catalogue,
+                                                    const Origins& origins,
+                                                    bool withDescription) {
+  Contents& contents = getContents(catalogue);
+  std::lock_guard<std::mutex> lock(contents.mutex);
+  if (!contents.loaded) {
+    readPorts(catalogue, withDescription, nullptr);
+  }
+
+  std::vector<Port> pkgs;
+  for (const auto& origin : origins) {
+    auto port = contents.ports.find(origin);
+    if (port != contents.ports.end()) {
+      pkgs.push_back(withDescription ? port->second : withoutDescription(port->second));
+    }
+  }
+
+  return pkgs;
+}
+
+Backend::Versions FixtureBackend::getVersions(Catalogue catalogue) {
+  Contents& contents = getContents(catalogue);
+  std::lock_guard<std::mutex> lock(contents.mutex);
+  if (!contents.loaded) {
+    readPorts(catalogue, false, nullptr);
+  }
+
+  Versions versions;
+  versions.reserve(contents.ports.size());
+  for (const auto& port : contents.ports) {
+    versions.emplace_back(port.first, port.second.version);
+  }
+
+  return versions;
+}
+
+Backend::Origins FixtureBackend::getDependencies(const Origins& origins) {
+  std::call_once(dependenciesRead_, &FixtureBackend::readDependencies, this);
+
+  Origins result;
+  for (const auto& origin : origins) {
+    auto dependencies = dependencies_.find(origin);
+    if (dependencies != dependencies_.end()) {
+      result.insert(result.end(), dependencies->second.begin(), dependencies->second.end());
+    }
+  }
+
+  return result;
+}
+
+Backend::Origins FixtureBackend::getDependents(const Origins& origins) {
+  std::call_once(dependenciesRead_, &FixtureBackend::readDependencies, this);
+
+  Contents& local = getContents(Catalogue::local);
+  std::lock_guard<std::mutex> lock(local.mutex);
+  if (!local.loaded) {
+    readPorts(Catalogue::local, true, nullptr);
+  }
+
+  Origins result;
+  for (const auto& origin : origins) {
+    auto dependents = dependents_.find(origin);
+    if (dependents == dependents_.end()) {
+      continue;
+    }
+    for (const auto& dependent : dependents->second) {
+      if (local.ports.find(dependent) != local.ports.end()) {
+        result.push_back(dependent);
+      }
+    }
+  }
+
+  return result;
+}
+
+// The dependencies file lists the remote ones, the local ones are those
+// of the installed ports.
+Backend::Edges FixtureBackend::getDependencyEdges(Catalogue catalogue) {
+  std::call_once(dependenciesRead_, &FixtureBackend::readDependencies, this);
+
+  Contents& local = getContents(Catalogue::local);
+  std::unique_lock<std::mutex> lock(local.mutex, std::defer_lock);
+  if (catalogue == Catalogue::local) {
+    lock.lock();
+    if (!local.loaded) {
+      readPorts(Catalogue::local, true, nullptr);
+    }
+  }
+
+  Edges edges;
+  for (const auto& dependencies : dependencies_) {
+    if (catalogue == Catalogue::local
+        && local.ports.find(dependencies.first) == local.ports.end()) {
+      continue;
+    }
+    for (const auto& dependency : dependencies.second) {
+      edges.emplace_back(dependencies.first, dependency);
+    }
+  }
+
+  return edges;
+}
+
+// Install the given ports and, before them, their missing dependencies.
+void FixtureBackend::install(const Origins& origins, Progress& progress) {
+  std::set<std::string> visited;
+  Origins pending(origins);
+  size_t index = 0;
+
+  // Make sure the local catalogue is read before modifying it
+  getPorts(Catalogue::local, Origins(), false);
+
+  while (!pending.empty()) {
+    std::string origin = pending.back();
+    pending.pop_back();
+    if (!visited.insert(origin).second) {
+      continue;
+    }
+    std::vector<Port> ports = getPorts(Catalogue::remote, Origins(1, origin), true);
+    if (ports.empty()) {
+      syslog(LOG_WARNING, "FixtureBackend::install(): no remote port [%s]", origin.c_str());
+      progress.addError("No remote port " + origin);
+      continue;
+    }
+
+    ++index;
+    progress.setPackage(Progress::Step::installing, origin, index, index + pending.size());
+    simulateLatency();
+    Contents& local = getContents(Catalogue::local);
+    std::lock_guard<std::mutex> lock(local.mutex);
+    local.ports[origin] = std::move(ports.front());
+    auto dependencies = dependencies_.find(origin);
+    if (dependencies != dependencies_.end()) {
+      for (const auto& dependency : dependencies->second) {
+        if (local.ports.find(dependency) == local.ports.end()) {
+          pending.push_back(dependency);
+        }
+      }
+    }
+  }
+}
+
+// Remove the given ports together with the installed ports depending
+// on them.
+void FixtureBackend::remove(const Origins& origins, Progress& progress) {
+  Origins pending(origins);
+  size_t index = 0;
+
+  while (!pending.empty()) {
+    std::string origin = pending.back();
+    pending.pop_back();
+    if (getPorts(Catalogue::local, Origins(1, origin), false).empty()) {
+      continue;
+    }
+
+    Origins dependents = getDependents(Origins(1, origin));
+    ++index;
+    progress.setPackage(Progress::Step::removing, origin, index, index + pending.size() + dependents.size());
+    simulateLatency();
+    Contents& local = getContents(Catalogue::local);
+    std::lock_guard<std::mutex> lock(local.mutex);
+    local.ports.erase(origin);
+    pending.insert(pending.end(), dependents.begin(), dependents.end());
+  }
+}
+
+FixtureBackend::Contents& FixtureBackend::getContents(Catalogue catalogue) {
+  return catalogues_[catalogue == Catalogue::local ? 0 : 1];
+}
+
+std::string FixtureBackend::getPath(Catalogue catalogue) const {
+  return dir_ + (catalogue == Catalogue::local ? "/local" : "/remote");
+}
+
+// Parse a catalogue in the format of the records output by pkg(8), and
+// hand its ports to the consumer if any while parsing. The catalogue
+// mutex must be held.
+void FixtureBackend::readPorts(Catalogue catalogue,
+                               bool withDescription,
+                               const Consumer* consumer) {
+  std::string path = getPath(catalogue);
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("FixtureBackend::readPorts(): could not open [" + path + "]");
+  }
+
+  Ports& ports = getContents(catalogue).ports;
+  std::vector<Port> batch;
+  Parser parser(fd);
+  Parser::Field field;
+  for (;;) {
+    Port port;
+
+    if (!parser.nextField(delimiter, field)) {
+      break;
+    }
+    port.origin.assign(field.data, field.len);
+    std::string* fields[] = {&port.version, &port.comment, &port.description};
+    for (auto text : fields) {
+      if (!parser.nextField(delimiter, field)) {
+        close(fd);
+        ports.clear();
+        throw std::runtime_error("FixtureBackend::readPorts(): truncated record for ["
+                                 + port.origin + "] in [" + path + "]");
+      }
+      text->assign(field.data, field.len);
+    }
+    // discard end of line
+    parser.skipPast('\n');
+
+    if (consumer != nullptr) {
+      batch.push_back(withDescription ? port : withoutDescription(port));
+      if (batch.size() == batchSize) {
+        (*consumer)(batch);
+        batch.clear();
+      }
+    }
+    std::string origin = port.origin;
+    ports[origin] = std::move(port);
+  }
+  close(fd);
+
+  if (consumer != nullptr && !batch.empty()) {
+    (*consumer)(batch);
+  }
+  getContents(catalogue).loaded = true;
+}
+
+void FixtureBackend::readDependencies() {
+  std::ifstream file(dir_ + "/dependencies");
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream fields(line);
+    std::string origin, dependency;
+    if (fields >> origin >> dependency) {
+      dependencies_[origin].push_back(dependency);
+      dependents_[dependency].push_back(origin);
+    }
+  }
+}
+
+void FixtureBackend::simulateLatency() const {
+  std::this_thread::sleep_for(std::chrono::milliseconds(latency_));
+}
+
+}
@@ -0,0 +1,96 @@
+/*-
+ * Copyright (c) 2016 Frederic Culot <culot@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+#include "backend.h"
+
+namespace portal {
+
+// Backend serving catalogues read from files, to develop and measure
+// portal on machines without pkg(8) or a live repository. The fixture
+// directory holds:
+//  - remote: the available ports, as output by
+//    pkg rquery -a '%o\2%v\2%c\2%e\2'
+//  - local: the installed ports, in the same format
+//  - dependencies (optional): one "origin dependency" pair per line,
+//    as output by pkg rquery -a '%o %do'
+//  - latency (optional): milliseconds spent installing or removing
+//    each port, 100 by default
+// Files are read when first needed. Transactions behave like
+// pkg(8) ones, installing the missing dependencies and removing the
+// dependent ports, but only update the local catalogue kept in memory.
+class FixtureBackend : public Backend {
+ public:
+  explicit FixtureBackend(const std::string& dir);
+
+  void               getPorts(Catalogue catalogue,
+                              bool withDescription,
+                              const Consumer& consumer) override;
+  std::vector<Port>  getPorts(Catalogue catalogue,
+                              const Origins& origins,
+                              bool withDescription) override;
+  Versions           getVersions(Catalogue catalogue) override;
+  Origins            getDependencies(const Origins& origins) override;
+  Origins            getDependents(const Origins& origins) override;
+  Edges              getDependencyEdges(Catalogue catalogue) override;
+  void               install(const Origins& origins, Progress& progress) override;
+  void               remove(const Origins& origins, Progress& progress) override;
+  bool               canModify() const override {return true;}
+  bool               getFingerprint(Catalogue, uint64_t&) const override {return false;}
+
+ private:
+  using Ports = std::map<std::string, Port>;
+
+  // Both catalogues can be queried concurrently, and the local one is
+  // modified by transactions, so each comes with its own mutex.
+  struct Contents {
+    std::mutex  mutex;
+    bool        loaded {false};
+    Ports       ports;
+  };
+
+  std::string                               dir_;
+  unsigned int                              latency_ {100};
+  std::once_flag                            dependenciesRead_;
+  std::unordered_map<std::string, Origins>  dependencies_;
+  std::unordered_map<std::string, Origins>  dependents_;
+  Contents                                  catalogues_[2];
+
+  Contents&     getContents(Catalogue catalogue);
+  std::string   getPath(Catalogue catalogue) const;
+  void          readPorts(Catalogue catalogue,
+                          bool withDescription,
+                          const Consumer* consumer);
+  void          readDependencies();
+  void          simulateLatency() const;
+};
+
+}
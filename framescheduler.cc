@@ -0,0 +1,75 @@
+/*-
+ * Copyright (c) 2016 Frederic Culot <culot@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+
+#include "framescheduler.h"
+
+namespace portal {
+
+FrameScheduler::FrameScheduler(int maxFps)
+  : frameInterval_(std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(1)) / maxFps),
+    nextFrame_(Clock::now()) {
+}
+
+// Wait until the next frame is due if one is pending, or for the given
+// tick otherwise.
+int FrameScheduler::getTimeoutMs(int tickMs) const {
+  if (!framePending_) {
+    return tickMs;
+  }
+  auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(nextFrame_ - Clock::now());
+
+  return std::max(0, static_cast<int>(remaining.count()));
+}
+
+// Any event may change what is displayed, but only key presses count
+// towards the latency.
+void FrameScheduler::eventReceived(const Event& event) {
+  framePending_ = true;
+  if (event.type() != Event::Type::tick && !inputPending_) {
+    inputTime_ = Clock::now();
+    inputPending_ = true;
+  }
+}
+
+bool FrameScheduler::isFrameDue() const {
+  return framePending_ && Clock::now() >= nextFrame_;
+}
+
+void FrameScheduler::frameDisplayed() {
+  Clock::time_point now = Clock::now();
+  if (inputPending_) {
+    std::chrono::duration<double, std::milli> latency = now - inputTime_;
+    latency_.maxMs = std::max(latency_.maxMs, latency.count());
+    latency_.meanMs += (latency.count() - latency_.meanMs) / ++latency_.frames;
+  }
+  nextFrame_ = now + frameInterval_;
+  framePending_ = false;
+  inputPending_ = false;
+}
+
+}
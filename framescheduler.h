@@ -0,0 +1,69 @@
+/*-
+ * Copyright (c) 2016 Frederic Culot <culot@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <chrono>
+
+#include "event.h"
+
+namespace portal {
+
+// Paces the frames displayed by the event loop. Events are handled as
+// they come, but a frame is only displayed once the input waiting was
+// drained, and no sooner than a frame interval after the previous one.
+// The time elapsed between the first key press shown by a frame and the
+// display of that frame is measured as its latency.
+class FrameScheduler {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Latency {
+    unsigned int  frames {0};  // frames displayed in response to input
+    double        meanMs {0};
+    double        maxMs {0};
+  };
+
+  static const int defaultMaxFps = 60;
+
+  explicit FrameScheduler(int maxFps = defaultMaxFps);
+
+  int      getTimeoutMs(int tickMs) const;
+  void     eventReceived(const Event& event);
+  bool     isFrameDue() const;
+  void     frameDisplayed();
+  Latency  getLatency() const {return latency_;}
+
+ private:
+  Clock::duration    frameInterval_;
+  Clock::time_point  nextFrame_;
+  Clock::time_point  inputTime_;
+  bool               framePending_ {false};
+  bool               inputPending_ {false};
+  Latency            latency_;
+};
+
+}
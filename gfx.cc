@@ -71,6 +71,20 @@ void Gfx::update() {
   mutex_.unlock();
 }
 
+// Repaint the whole terminal on the next update, should it be garbled
+void Gfx::redraw() {
+  mutex_.lock();
+  clearok(curscr, TRUE);
+  mutex_.unlock();
+  damage();
+}
+
+// Have every window composed again when next drawn, even if it did not
+// change, as what it showed was overwritten, by a popup for instance
+void Gfx::damage() {
+  ++generation_;
+}
+
 void Gfx::terminate() {
   clear();
   endwin();
@@ -26,6 +26,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <mutex>
 #include <curses.h>
 
@@ -150,10 +151,14 @@ class Gfx {
 
   void         init();
   void         update();
+  void         redraw();
+  void         damage();
+  unsigned int generation() const {return generation_;}
   void         terminate();
 
  private:
-  std::mutex  mutex_;
+  std::mutex                 mutex_;
+  std::atomic<unsigned int>  generation_ {0};
 
   Gfx() {}
   ~Gfx() {}
@@ -71,6 +71,7 @@ std::string InputWindow::getInput() {
       break;
     }
     print(content_);
+    draw();
     Gfx::instance().update();
   }
 }
@@ -78,6 +79,7 @@ std::string InputWindow::getInput() {
 void InputWindow::setContent(const std::string& content) {
   content_ = content;
   print(content_);
+  draw();
   Gfx::instance().update();
 }
 
@@ -0,0 +1,124 @@
+/*-
+ * Copyright (c) 2016 Frederic Culot <culot@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include "parser.h"
+
+namespace portal {
+
+Parser::Parser(int fd, size_t blockSize)
+  : fd_(fd), buf_(blockSize), start_(std::chrono::steady_clock::now()) {
+}
+
+bool Parser::nextField(char delim, Field& field) {
+  const char* pos = find(delim);
+  if (pos == nullptr) {
+    return false;
+  }
+
+  field.data = buf_.data() + begin_;
+  field.len = pos - field.data;
+  begin_ += field.len + 1;
+
+  return true;
+}
+
+bool Parser::skipPast(char delim) {
+  const char* pos = find(delim);
+  if (pos == nullptr) {
+    return false;
+  }
+  begin_ = pos - buf_.data() + 1;
+
+  return true;
+}
+
+double Parser::elapsedSeconds() const {
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_;
+  return elapsed.count();
+}
+
+double Parser::throughput() const {
+  double seconds = elapsedSeconds();
+  return seconds > 0 ? bytesRead_ / seconds / (1024 * 1024) : 0;
+}
+
+// Look for the next delimiter, reading more data from the descriptor
+// as needed. Only the bytes that were not scanned yet are passed to
+// memchr, so a field spanning several blocks is not scanned twice.
+const char* Parser::find(char delim) {
+  size_t scanned = begin_;
+
+  for (;;) {
+    const void* pos = memchr(buf_.data() + scanned, delim, end_ - scanned);
+    if (pos != nullptr) {
+      return static_cast<const char*>(pos);
+    }
+    scanned = end_ - begin_;
+    if (!fill()) {
+      return nullptr;
+    }
+    scanned += begin_;
+  }
+}
+
+// Move the pending bytes to the front of the buffer, growing it if a
+// single field does not fit, and append the next block of data.
+bool Parser::fill() {
+  if (eof_) {
+    return false;
+  }
+
+  if (begin_ > 0) {
+    memmove(buf_.data(), buf_.data() + begin_, end_ - begin_);
+    end_ -= begin_;
+    begin_ = 0;
+  }
+  if (end_ == buf_.size()) {
+    buf_.resize(buf_.size() * 2);
+  }
+
+  for (;;) {
+    ssize_t len = read(fd_, buf_.data() + end_, buf_.size() - end_);
+    if (len > 0) {
+      end_ += len;
+      bytesRead_ += len;
+      return true;
+    } else if (len == 0) {
+      eof_ = true;
+      return false;
+    } else if (errno != EINTR) {
+      throw std::runtime_error(std::string("Parser::fill(): read error: ")
+                               + strerror(errno));
+    }
+  }
+}
+
+}
@@ -0,0 +1,69 @@
+/*-
+ * Copyright (c) 2016 Frederic Culot <culot@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace portal {
+
+// Block-oriented reader used to split the output of pkg(8) into
+// delimited fields. Data is read from the file descriptor in large
+// chunks, and fields are handed out as slices of the internal buffer:
+// a field remains valid until the next call to nextField() or skipPast().
+class Parser {
+ public:
+  struct Field {
+    const char* data {nullptr};
+    size_t      len {0};
+
+    std::string str() const {return std::string(data, len);}
+  };
+
+  explicit Parser(int fd, size_t blockSize = 64 * 1024);
+
+  bool    nextField(char delim, Field& field);
+  bool    skipPast(char delim);
+  size_t  bytesRead() const {return bytesRead_;}
+  double  elapsedSeconds() const;
+  double  throughput() const;
+
+ private:
+  int                                    fd_;
+  bool                                   eof_ {false};
+  size_t                                 begin_ {0};
+  size_t                                 end_ {0};
+  size_t                                 bytesRead_ {0};
+  std::vector<char>                      buf_;
+  std::chrono::steady_clock::time_point  start_;
+
+  const char* find(char delim);
+  bool        fill();
+};
+
+}
@@ -25,189 +25,355 @@
  */
 
 #include <unistd.h>
+#include <syslog.h>
+#include <regex.h>
 #include <sys/types.h>
 #include <cstdio>
+#include <cstdlib>
+#include <cctype>
 #include <fstream>
 #include <sstream>
 #include <stdexcept>
 #include <algorithm>
-
+#include <numeric>
+#include <chrono>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <set>
+
+#include "hash.h"
 #include "pkg.h"
+#include "pkgbackend.h"
 
 namespace portal {
 
-static const char delimiter = '\2';
+// Above this number of ports, refreshing the repository after a
+// transaction is done by reloading it completely.
+static const size_t maxRefreshedPorts = 2000;
+
+// Time spent merging the ports loaded in the background at once
+static const std::chrono::milliseconds mergeTimeBudget(50);
+
+// Interval at which the catalogues are checked for modifications made
+// by other pkg(8) invocations
+static const std::chrono::seconds watchInterval(2);
+
+// Number of descriptions fetched by a single query when they are
+// loaded on demand.
+static const size_t descriptionsBatchSize = 64;
 
-Pkg::Pkg() {
-  checkPrivileges();
+// Number of queries whose results are kept by the searcher, and number
+// of candidates it matches between two checks for a newer query.
+static const size_t maxCachedSearches = 16;
+static const size_t searchCheckInterval = 256;
+
+// Patterns with none of these characters are plain strings, whose
+// matches are also matches of any shorter string they contain.
+static bool isPlainPattern(const std::string& pattern) {
+  return pattern.find_first_of(".[]()*+?{}|^$\\") == std::string::npos;
 }
 
-void Pkg::checkPrivileges() {
-  rootPrivileges_ = getuid() ? false : true;
+static bool containsIgnoringCase(const std::string& text, const std::string& pattern) {
+  auto it = std::search(text.begin(), text.end(), pattern.begin(), pattern.end(),
+                        [](char lhs, char rhs) {
+                          return std::tolower(static_cast<unsigned char>(lhs))
+                            == std::tolower(static_cast<unsigned char>(rhs));
+                        });
+  return it != text.end();
 }
 
-void Pkg::reload(Repo repo) {
-  switchToReferenceRepository();
-  refPkgs_.clear();
+static Backend::Catalogue getCatalogue(Pkg::Repo repo) {
+  return repo == Pkg::Repo::local ? Backend::Catalogue::local : Backend::Catalogue::remote;
+}
 
-  switch (repo) {
-  case Repo::all:
-    buildPackagesList(Repo::remote);
-    buildPackagesList(Repo::local);
-    break;
+Pkg::Pkg()
+  : backend_(new PkgBackend) {
+  switchToReferenceRepository();
+}
 
-  default:
-    buildPackagesList(repo);
-    break;
+Pkg::~Pkg() {
+  if (searcher_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(searchMutex_);
+      searcherStop_ = true;
+      ++searchGeneration_;
+    }
+    searchCond_.notify_all();
+    searcher_.join();
+  }
+  if (loader_.joinable()) {
+    loader_.join();
+  }
+  if (watcher_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(watchMutex_);
+      watcherStop_ = true;
+    }
+    watchCond_.notify_all();
+    watcher_.join();
+  }
+  if (descrLoader_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(descrMutex_);
+      descrLoaderStop_ = true;
+    }
+    descrCond_.notify_all();
+    descrLoader_.join();
+  }
+  if (saver_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(saveMutex_);
+      saverStop_ = true;
+    }
+    saveCond_.notify_all();
+    saver_.join();
   }
 }
 
-void Pkg::buildPackagesList(Repo repo) {
-  std::vector<Port> pkgs;
+void Pkg::setBackend(std::unique_ptr<Backend> backend) {
+  backend_ = std::move(backend);
+}
+
+void Pkg::reload(Repo repo) {
+  auto lock = lockStore();
+  reloadStore(repo);
+}
+
+void Pkg::reloadStore(Repo repo) {
+  switchToReferenceRepository();
+  resetDescriptions();
+  localGraph_.clear();
+  remoteGraph_.clear();
+  if (graphEnabled_) {
+    startLoadingGraph();
+  }
+
+  if (repo == Repo::all && loadSnapshot()) {
+    return;
+  }
+
+  uint64_t fingerprint;
+  bool fingerprinted = repo == Repo::all && getCatalogueFingerprint(fingerprint);
+  store_.clear();
   switch (repo) {
-  case Repo::local: {
-    std::stringstream args;
-    args << "query -a '%o"
-         << delimiter
-         << "%v"
-         << delimiter
-         << "%c"
-         << delimiter
-         << "%e"
-         << delimiter
-         << "'";
-    pkgs = runPkg(args.str());
-    fillPkgRepo(Repo::local, pkgs);
+  case Repo::all: {
+    // The remote and local queries do not depend on each other, so
+    // run them concurrently. Calling get() rethrows any error raised
+    // while loading the remote packages.
+    std::future<void> remote = std::async(std::launch::async,
+                                          &Pkg::buildPackagesList,
+                                          this,
+                                          Repo::remote);
+    buildPackagesList(Repo::local);
+    remote.get();
     break;
   }
 
-  case Repo::remote: {
-    std::stringstream args;
-    args << "rquery -a '%o"
-         << delimiter
-         << "%v"
-         << delimiter
-         << "%c"
-         << delimiter
-         << "%e"
-         << delimiter
-         << "'";
-    pkgs = runPkg(args.str());
-    fillPkgRepo(Repo::remote, pkgs);
+  default:
+    buildPackagesList(repo);
     break;
   }
 
-    default:
-      break;
+  store_.sort();
+  store_.statusBitmap(Statuses::installed).forEach([this](size_t id) {
+      updateUpgradeStatus(id);
+    });
+  resetSearchIndex();
+  if (fingerprinted) {
+    saveSnapshot(fingerprint);
   }
 }
 
-std::tuple<bool, std::string> Pkg::extractToken(FILE * fp, const char delim) const {
-  std::string token;
-
-  for (;;) {
-    int c = fgetc(fp);
+// Load the whole catalogue in the background, so that the interface can
+// be displayed meanwhile. The loader thread only queues the batches of
+// ports it reads: they are merged into the store by mergeLoadedPorts(),
+// from the thread the rest of Pkg is used from, while browsing the
+// ports already merged.
+void Pkg::startLoading() {
+  auto lock = lockStore();
+  switchToReferenceRepository();
+  resetDescriptions();
+  loadStart_ = std::chrono::steady_clock::now();
 
-    if (c == EOF) {
-      return std::make_tuple(true, std::string());
-    } else if (c == delim) {
-      return std::make_tuple(false, token);
-    } else {
-      token.push_back(c);
-    }
+  if (loadSnapshot()) {
+    startLoadingGraph();
+    return;
   }
-}
 
-void Pkg::execPkg(const std::string& args) const {
-  std::string cmd("pkg " + args);
+  store_.clear();
+  resetSearchIndex();
+  loadFingerprinted_ = getCatalogueFingerprint(loadFingerprint_);
+  loaderDone_ = false;
+  setLoading(true);
+  loader_ = std::thread(&Pkg::loadCatalogues, this);
+}
 
-  FILE * pipe = popen(cmd.c_str(), "r");
-  if (!pipe) {
-    throw std::runtime_error("Pkg::execPkg(): could not execute [" + cmd + "]");
+// Body of the loader thread. Errors are rethrown by mergeLoadedPorts().
+void Pkg::loadCatalogues() {
+  try {
+    std::future<void> remote = std::async(std::launch::async,
+                                          &Pkg::queuePackagesList,
+                                          this,
+                                          Repo::remote);
+    queuePackagesList(Repo::local);
+    remote.get();
+  }
+  catch (...) {
+    std::lock_guard<std::mutex> lock(loadMutex_);
+    loadError_ = std::current_exception();
   }
-  pclose(pipe);
+
+  std::lock_guard<std::mutex> lock(loadMutex_);
+  loaderDone_ = true;
 }
 
-std::vector<Pkg::Port> Pkg::runPkg(const std::string & args) const {
-  std::string cmd("pkg " + args);
+void Pkg::queuePackagesList(Repo repo) {
+  backend_->getPorts(getCatalogue(repo), !lazyDescriptions_, [this, repo](std::vector<Port>& ports) {
+      std::lock_guard<std::mutex> lock(loadMutex_);
+      loadedPorts_.push_back({repo, std::move(ports)});
+    });
+}
 
-  FILE * pipe = popen(cmd.c_str(), "r");
-  if (!pipe) {
-    throw std::runtime_error("Pkg::runPkg(): could not execute [" + cmd + "]");
+// Merge the ports queued by the loader thread, and return true if the
+// store changed. Merging stops once mergeTimeBudget is spent, so that
+// the caller stays responsive, and resumes with the next call. Once
+// everything was merged, the loader thread is joined and the snapshot
+// saved.
+bool Pkg::mergeLoadedPorts() {
+  if (!loader_.joinable()) {
+    return false;
   }
 
-  std::vector<Pkg::Port> result;
-
-  bool eof;
-  do {
-    struct Port port;
-
-    std::tie(eof, port.origin) = extractToken(pipe, delimiter);
-    if (eof) {
-      break;
+  auto start = std::chrono::steady_clock::now();
+  size_t numPorts = store_.size();
+  std::vector<LoadedPorts> batches;
+  bool done = false;
+  std::unique_lock<std::shared_mutex> storeLock;
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> lock(loadMutex_);
+      if (loadedPorts_.empty()) {
+        done = loaderDone_;
+        break;
+      }
+      batches.push_back(std::move(loadedPorts_.front()));
+      loadedPorts_.pop_front();
     }
-    std::tie(eof, port.remoteVersion) = extractToken(pipe, delimiter);
-    if (eof) {
+    if (!storeLock.owns_lock()) {
+      storeLock = lockStore();
+    }
+    fillPkgRepo(batches.back().repo, batches.back().ports);
+    if (std::chrono::steady_clock::now() - start > mergeTimeBudget) {
       break;
     }
-    std::tie(eof, port.comment) = extractToken(pipe, delimiter);
-    if (eof) {
-      throw std::runtime_error("Pkg::runPkg(): EOF reached when reading comment for ["
-                               + port.origin + "]");
+  }
+
+  if (store_.size() != numPorts) {
+    store_.sort();
+  }
+  // A search run while loading built the index from the ports merged so
+  // far, which is completed rather than built again.
+  for (const auto& batch : batches) {
+    for (const auto& port : batch.ports) {
+      PkgId id;
+      if (store_.find(port.origin, id)) {
+        updateUpgradeStatus(id);
+        indexPort(id);
+      }
+    }
+  }
+
+  if (done) {
+    if (!storeLock.owns_lock()) {
+      storeLock = lockStore();
+    }
+    loader_.join();
+    setLoading(false);
+    if (loadError_) {
+      std::exception_ptr error = loadError_;
+      loadError_ = nullptr;
+      std::rethrow_exception(error);
     }
-    std::tie(eof, port.description) = extractToken(pipe, delimiter);
-    if (eof) {
-      throw std::runtime_error("Pkg::runPkg(): EOF reached when reading descr for ["
-                               + port.origin + "]");
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - loadStart_;
+    syslog(LOG_INFO, "Pkg::mergeLoadedPorts(): loaded %zu packages in %.3fs",
+           store_.size(), elapsed.count());
+    if (loadFingerprinted_) {
+      saveSnapshot(loadFingerprint_);
     }
-    // discard end of line
-    fgetc(pipe);
+    startLoadingGraph();
+  }
+
+  return done || !batches.empty();
+}
 
-    result.push_back(port);
+// Loading the whole catalogue from a snapshot only makes sense if it
+// was saved while the pkg database and the repositories catalogues
+// were in the same state as they are now.
+bool Pkg::loadSnapshot() {
+  if (!useSnapshot_) {
+    return false;
+  }
 
-  } while (!eof);
+  std::string snapshotPath = getSnapshotPath();
+  uint64_t fingerprint;
+  if (snapshotPath.empty() || !getCatalogueFingerprint(fingerprint)
+      || !store_.load(snapshotPath, fingerprint)) {
+    return false;
+  }
 
-  pclose(pipe);
+  syslog(LOG_INFO, "Pkg::loadSnapshot(): loaded %zu packages from [%s]",
+         store_.size(), snapshotPath.c_str());
+  resetSearchIndex();
 
-  return result;
+  return true;
 }
 
-std::vector<Pkg::Port> Pkg::runPkgSearch(const std::string & args) const {
-  std::string cmd("pkg " + args);
-
-  FILE * pipe = popen(cmd.c_str(), "r");
-  if (!pipe)
-    throw std::runtime_error("Pkg::runPkgSearch(): could not execute [" + cmd + "]");
+std::string Pkg::getSnapshotPath() const {
+  const char* home = getenv("HOME");
+  if (home == nullptr || *home == '\0') {
+    return std::string();
+  }
 
-  std::vector<Pkg::Port> result;
+  return std::string(home) + "/.portal.cache";
+}
 
-  bool eof;
-  char buf[1024];
-  do {
-    struct Port port;
+// Snapshots saved without descriptions must not be used otherwise.
+bool Pkg::getCatalogueFingerprint(uint64_t& fingerprint) const {
+  uint64_t remote;
+  if (!backend_->getFingerprint(Backend::Catalogue::local, fingerprint)
+      || !backend_->getFingerprint(Backend::Catalogue::remote, remote)) {
+    return false;
+  }
+  fingerprint = fnv1a(&remote, sizeof(remote), fingerprint);
+  fingerprint = fnv1a(&lazyDescriptions_, sizeof(lazyDescriptions_), fingerprint);
 
-    std::tie(eof, port.origin) = extractToken(pipe, ' ');
-    if (eof) {
-      break;
-    }
-    // discard to the end of line
-    fgets(buf, sizeof(buf), pipe);
+  return true;
+}
 
-    result.push_back(port);
-  } while (!eof);
+void Pkg::buildPackagesList(Repo repo) {
+  backend_->getPorts(getCatalogue(repo), !lazyDescriptions_, [this, repo](std::vector<Port>& ports) {
+      std::lock_guard<std::mutex> lock(fillMutex_);
+      fillPkgRepo(repo, ports);
+    });
+}
 
-  pclose(pipe);
+bool Pkg::isRepositoryEmpty() const {
+  for (const auto& ids : *pkgs_) {
+    if (!ids.empty()) {
+      return false;
+    }
+  }
 
-  return result;
+  return true;
 }
 
-
 std::vector<std::string> Pkg::getPkgOrigins() const {
   std::vector<std::string> origins;
 
-  for (const auto& pkg : *pkgs_) {
-    for (const auto& port : pkg.second) {
-      origins.push_back(port.origin);
+  for (const auto& category : store_.sortedCategories()) {
+    for (const auto& id : (*pkgs_)[category]) {
+      origins.push_back(store_.text(id, Store::Text::origin));
     }
   }
 
@@ -217,231 +383,1270 @@ std::vector<std::string> Pkg::getPkgOrigins() const {
 std::vector<std::string> Pkg::getPkgOrigins(const std::string& category) const {
   std::vector<std::string> portsList;
 
-  if (pkgs_->find(category) != pkgs_->end()) {
-    for (const auto& port : pkgs_->at(category)) {
-      portsList.push_back(port.origin);
-    }
+  for (const auto& id : getSelection(category)) {
+    portsList.push_back(store_.text(id, Store::Text::origin));
   }
 
   return portsList;
 }
 
+const std::vector<Pkg::PkgId>& Pkg::getPkgIds(const std::string& category) const {
+  return getSelection(category);
+}
+
+Pkg::PkgId Pkg::getPkgId(const std::string& origin) const {
+  PkgId id;
+  if (!store_.find(origin, id)) {
+    throw std::runtime_error("Pkg::getPkgId(): port [" + origin + "] not found");
+  }
+
+  return id;
+}
+
 std::string Pkg::getLocalVersion(const std::string& origin) const {
-  const Port& port = getPort(origin);
+  return getLocalVersion(getPkgId(origin));
+}
 
-  return port.localVersion;
+std::string Pkg::getLocalVersion(PkgId id) const {
+  checkId(id);
+
+  return store_.text(id, Store::Text::localVersion);
 }
 
 std::string Pkg::getRemoteVersion(const std::string& origin) const {
-  const Port& port = getPort(origin);
+  return getRemoteVersion(getPkgId(origin));
+}
+
+std::string Pkg::getRemoteVersion(PkgId id) const {
+  checkId(id);
 
-  return port.remoteVersion;
+  return store_.text(id, Store::Text::remoteVersion);
 }
 
 
 std::string Pkg::getPkgAttr(const std::string& origin, Attr attr) const {
-  const Port& port = getPort(origin);
+  return getPkgAttr(getPkgId(origin), attr);
+}
+
+std::string Pkg::getPkgAttr(PkgId id, Attr attr) const {
+  checkId(id);
   switch (attr) {
   case Attr::origin:
-    return port.origin;
+    return store_.text(id, Store::Text::origin);
   case Attr::status:
-    return getCurrentStatusAsString(port.origin);
+    return getCurrentStatusAsString(id);
   case Attr::category:
-    return getCategoryFromOrigin(port.origin);
+    return store_.categoryName(store_.category(id));
   case Attr::name:
-    return getNameFromOrigin(port.origin);
+    return std::string(store_.name(id));
   case Attr::comment:
-    return port.comment;
+    return store_.text(id, Store::Text::comment);
   case Attr::description:
-    return port.description;
+    return lazyDescriptions_ ? getDescription(id) : store_.text(id, Store::Text::description);
   case Attr::localVersion:
-    return port.localVersion;
+    return store_.text(id, Store::Text::localVersion);
   case Attr::remoteVersion:
-    return port.remoteVersion;
+    return store_.text(id, Store::Text::remoteVersion);
   }
 }
 
+// Categories are listed by name, including those with no port selected
+const std::vector<Pkg::CategoryId>& Pkg::getCategoryIds() const {
+  return store_.sortedCategories();
+}
+
+std::string_view Pkg::getCategoryName(CategoryId category) const {
+  return store_.categoryName(category);
+}
+
+const std::vector<Pkg::PkgId>& Pkg::getPkgIds(CategoryId category) const {
+  static const std::vector<PkgId> emptySelection;
+
+  return category < pkgs_->size() ? (*pkgs_)[category] : emptySelection;
+}
+
+std::string_view Pkg::getPkgAttrView(PkgId id, Attr attr) const {
+  checkId(id);
+  switch (attr) {
+  case Attr::origin:
+    return store_.textView(id, Store::Text::origin);
+  case Attr::status:
+    return store_.hasStatus(id, installed) ? "+" : "-";
+  case Attr::category:
+    return store_.categoryName(store_.category(id));
+  case Attr::name:
+    return store_.name(id);
+  case Attr::comment:
+    return store_.textView(id, Store::Text::comment);
+  case Attr::localVersion:
+    return store_.textView(id, Store::Text::localVersion);
+  case Attr::remoteVersion:
+    return store_.textView(id, Store::Text::remoteVersion);
+  case Attr::description:
+    break;
+  }
+
+  throw std::runtime_error("Pkg::getPkgAttrView(): descriptions cannot be viewed");
+}
+
 std::vector<std::string> Pkg::getPkgCategories() const {
   std::vector<std::string> categories;
-  for (const auto & category : (*pkgs_)) {
-    categories.push_back(category.first);
+  for (const auto& category : store_.sortedCategories()) {
+    if (!(*pkgs_)[category].empty()) {
+      categories.push_back(store_.categoryName(category));
+    }
   }
 
   return categories;
 }
 
 unsigned int Pkg::getCategorySize(const std::string& category) const {
-  unsigned int size = 0;
-
-  if (pkgs_->find(category) != pkgs_->end()) {
-    size = pkgs_->at(category).size();
-  }
-
-  return size;
+  return getSelection(category).size();
 }
 
 void Pkg::fillPkgRepo(Repo repo, std::vector<Port>& pkgs) {
-  for (auto& port : pkgs) {
+  for (const auto& port : pkgs) {
+    bool inserted;
+    PkgId id = store_.insert(port.origin, inserted);
+
+    // The local and remote repositories are filled concurrently, so
+    // either one can come first. If the port is already known, only
+    // merge the fields provided by the current repository: the local
+    // one brings the installed status and version, the remote one the
+    // latest version together with the comment and description.
+    // Ports only known locally have no remote version. The actions
+    // marked by the user are kept.
     if (repo == Repo::local) {
-      port.status.set(Statuses::installed);
-      port.localVersion = port.remoteVersion;
+      Status status = store_.status(id);
+      status &= Status().set(Statuses::pendingInstall).set(Statuses::pendingRemoval);
+      store_.setStatus(id, status.set(Statuses::installed));
+      store_.setText(id, Store::Text::localVersion, port.version);
     } else {
-      port.status.set(Statuses::available);
-    }
-
-    std::string portCategory = getCategoryFromOrigin(port.origin);
-    std::set<Port>::iterator it = (*pkgs_)[portCategory].find(port);
-
-    // The local repository is filled after the remote was,
-    // hence we need to update fields specific to local status
-    // and version. Otherwise we can insert the port as is.
-    if ((*pkgs_)[portCategory].end() != it) {
-      it->status = port.status;
-      it->localVersion = port.localVersion;
-      // For now let's assume that if the port's local and
-      // remote version differ, then the port is outdated.
-      // This does not take into account the fact that a
-      // port could be created locally based on a version
-      // of the software newer than the one available in
-      // remote repositories. I expect this case to be an
-      // exception to avoid costly comparisons.
-      if (it->localVersion != it->remoteVersion) {
-        it->status.set(Statuses::upgradable);
+      if (!store_.hasStatus(id, Statuses::installed)) {
+        store_.setStatus(id, Statuses::available);
       }
-    } else {
-      (*pkgs_)[portCategory].insert(port);
+      store_.setText(id, Store::Text::remoteVersion, port.version);
     }
+    if (inserted || repo != Repo::local) {
+      store_.setText(id, Store::Text::comment, port.comment);
+      store_.setText(id, Store::Text::description, port.description);
+    }
+
+  }
+}
+
+// Compare the installed version of a port with the one available from
+// the remote repositories, following the ordering used by pkg(8). The
+// versions were decomposed when loaded, so this is a matter of
+// comparing integers.
+void Pkg::updateUpgradeStatus(PkgId id) {
+  int cmp = 0;
+  if (store_.hasStatus(id, Statuses::installed)
+      && store_.hasText(id, Store::Text::localVersion)
+      && store_.hasText(id, Store::Text::remoteVersion)) {
+    cmp = store_.compareVersions(id);
   }
+  store_.setStatus(id, Statuses::upgradable, cmp < 0);
+  store_.setStatus(id, Statuses::downgradable, cmp > 0);
 }
 
-void Pkg::fillTmpRepo(std::vector<Port>& pkgs) {
-  tmpPkgs_.clear();
+// Build the search/filter selection out of a list of identifiers, in
+// the same order as the reference repository. Only the identifiers of
+// the matching ports are touched, and the lists of the previous
+// selection are reused, so that no allocation is needed once they grew.
+void Pkg::fillTmpRepo(const std::vector<PkgId>& ids) {
+  clearTmpRepo();
+  for (const auto& id : ids) {
+    tmpPkgs_[store_.category(id)].push_back(id);
+  }
+  for (auto& selection : tmpPkgs_) {
+    std::sort(selection.begin(), selection.end(),
+              [this](PkgId lhs, PkgId rhs) {
+                return store_.position(lhs) < store_.position(rhs);
+              });
+  }
   switchToTemporaryRepository();
-  fillPkgRepo(Repo::tmp, pkgs);
+}
+
+void Pkg::clearTmpRepo() {
+  tmpPkgs_.resize(store_.members().size());
+  for (auto& selection : tmpPkgs_) {
+    selection.clear();
+  }
+}
+
+void Pkg::checkId(PkgId id) const {
+  if (id >= store_.size()) {
+    throw std::runtime_error("Pkg::checkId(): invalid id ["
+                             + std::to_string(id) + "]");
+  }
+}
+
+const std::vector<Pkg::PkgId>& Pkg::getSelection(const std::string& category) const {
+  static const std::vector<PkgId> emptySelection;
+
+  CategoryId id;
+  if (!store_.findCategory(category, id) || id >= pkgs_->size()) {
+    return emptySelection;
+  }
+
+  return (*pkgs_)[id];
 }
 
 std::string Pkg::getCurrentStatusAsString(const std::string& origin) const {
-  const Pkg::Port& port = getPort(origin);
-  return port.status[installed] ? "+" : "-";
+  return getCurrentStatusAsString(getPkgId(origin));
+}
+
+std::string Pkg::getCurrentStatusAsString(PkgId id) const {
+  checkId(id);
+  return store_.hasStatus(id, installed) ? "+" : "-";
 }
 
 std::string Pkg::getPendingStatusAsString(const std::string& origin) const {
-  const Pkg::Port& port = getPort(origin);
-  return port.status[pendingInstall] ? "+" : "-";
+  return getPendingStatusAsString(getPkgId(origin));
+}
+
+std::string Pkg::getPendingStatusAsString(PkgId id) const {
+  checkId(id);
+  return store_.hasStatus(id, pendingInstall) ? "+" : "-";
 }
 
 bool Pkg::hasPendingActions(const std::string& origin) const {
-  const Pkg::Port& port = getPort(origin);
-  return (port.status[pendingInstall] || port.status[pendingRemoval]);
+  return hasPendingActions(getPkgId(origin));
+}
+
+bool Pkg::hasPendingActions(PkgId id) const {
+  checkId(id);
+  return store_.hasStatus(id, pendingInstall) || store_.hasStatus(id, pendingRemoval);
 }
 
 bool Pkg::isUpgradable(const std::string& origin) const {
-  const Pkg::Port& port = getPort(origin);
-  return (port.status[upgradable]);
+  return isUpgradable(getPkgId(origin));
 }
 
-const Pkg::Port& Pkg::getPort(const std::string& origin) const {
-  std::string category = getCategoryFromOrigin(origin);
+bool Pkg::isUpgradable(PkgId id) const {
+  checkId(id);
+  return store_.hasStatus(id, upgradable);
+}
 
-  if (refPkgs_.find(category) != refPkgs_.end()) {
-    const std::set<Port>& portSet = refPkgs_.at(category);
-    for (const auto& port : portSet) {
-      if (port.origin == origin) {
-        return port;
-      }
-    }
-  }
+bool Pkg::isDowngradable(const std::string& origin) const {
+  return isDowngradable(getPkgId(origin));
+}
 
-  throw std::runtime_error("Pkg::getPort(): port [" + origin + "] not found");
+bool Pkg::isDowngradable(PkgId id) const {
+  checkId(id);
+  return store_.hasStatus(id, downgradable);
 }
 
-std::string Pkg::getCategoryFromOrigin(const std::string& origin) const {
-  return std::string(origin, 0, origin.find('/'));
+std::string_view Pkg::getCategoryFromOrigin(std::string_view origin) {
+  return origin.substr(0, origin.find('/'));
 }
 
-std::string Pkg::getNameFromOrigin(const std::string& origin) const {
-  return std::string(origin, origin.find('/') + 1);
+std::string_view Pkg::getNameFromOrigin(std::string_view origin) {
+  size_t slash = origin.find('/');
+  return slash != std::string_view::npos ? origin.substr(slash + 1) : origin;
 }
 
 void Pkg::registerInstall(const std::string& origin) {
-  const Port& port = getPort(origin);
-  if (!port.status[installed]) {
-    port.status.set(pendingInstall);
+  registerInstall(getPkgId(origin));
+}
+
+void Pkg::registerInstall(PkgId id) {
+  checkId(id);
+  if (!store_.hasStatus(id, installed)) {
+    store_.setStatus(id, pendingInstall);
   } else {
-    if (port.status[pendingRemoval]) {
-      port.status.reset(pendingRemoval);
-    } else if (port.status[upgradable]) {
-      port.status.set(pendingInstall);
+    if (store_.hasStatus(id, pendingRemoval)) {
+      store_.setStatus(id, pendingRemoval, false);
+    } else if (store_.hasStatus(id, upgradable)) {
+      store_.setStatus(id, pendingInstall);
     }
   }
 }
 
 void Pkg::registerRemoval(const std::string& origin) {
-  const Port& port = getPort(origin);
-  if (port.status[pendingInstall]) {
-    port.status.reset(pendingInstall);
-  } else if (port.status[installed]) {
-    port.status.set(pendingRemoval);
+  registerRemoval(getPkgId(origin));
+}
+
+void Pkg::registerRemoval(PkgId id) {
+  checkId(id);
+  if (store_.hasStatus(id, pendingInstall)) {
+    store_.setStatus(id, pendingInstall, false);
+  } else if (store_.hasStatus(id, installed)) {
+    store_.setStatus(id, pendingRemoval);
   }
 }
 
 void Pkg::performPending() {
-  std::string install, remove;
-
-  for (const auto& category : refPkgs_) {
-    for (const auto& port : category.second) {
-      if (port.status[pendingInstall]) {
-        install.append(" ");
-        install.append(port.origin);
-      } else if (port.status[pendingRemoval]) {
-        remove.append(" ");
-        remove.append(port.origin);
+  std::vector<std::string> install, remove;
+
+  for (const auto& category : store_.sortedCategories()) {
+    const std::vector<PkgId>& ids = store_.members()[category];
+    store_.statusBitmap(category, pendingInstall).forEach([&](size_t position) {
+        install.push_back(store_.text(ids[position], Store::Text::origin));
+      });
+    store_.statusBitmap(category, pendingRemoval).forEach([&](size_t position) {
+        remove.push_back(store_.text(ids[position], Store::Text::origin));
+      });
+  }
+  progress_.start();
+  if (install.empty() && remove.empty()) {
+    return;
+  }
+
+  // Besides the pending ports themselves, a transaction can install
+  // dependencies and remove or reinstall the ports depending on them.
+  // Those must be known before the transaction, as the dependencies of
+  // removed ports cannot be queried anymore afterwards.
+  std::vector<std::string> installed = remove;
+  for (const auto& origin : install) {
+    if (store_.hasStatus(getPkgId(origin), Statuses::installed)) {
+      installed.push_back(origin);
+    }
+  }
+  std::vector<std::string> dependencies = getDependencyClosure(&Backend::getDependencies, install);
+  std::vector<std::string> dependents = getDependencyClosure(&Backend::getDependents, installed);
+  std::set<std::string> affectedSet(dependencies.begin(), dependencies.end());
+  affectedSet.insert(dependents.begin(), dependents.end());
+  std::vector<std::string> affected(affectedSet.begin(), affectedSet.end());
+
+  // A failed transaction may still have modified some of the ports, so
+  // those are refreshed before reporting the failure.
+  std::exception_ptr error;
+  setTransacting(true);
+  try {
+    if (!remove.empty()) {
+      progress_.beginJob(remove.size());
+      backend_->remove(remove, progress_);
+      progress_.endJob();
+    }
+    if (!install.empty()) {
+      progress_.beginJob(install.size());
+      backend_->install(install, progress_);
+      progress_.endJob();
+    }
+  }
+  catch (std::exception&) {
+    error = std::current_exception();
+  }
+  setTransacting(false);
+
+  uint64_t fingerprint;
+  bool fingerprinted = getCatalogueFingerprint(fingerprint);
+  {
+    auto lock = lockStore();
+    if (affected.size() > maxRefreshedPorts) {
+      reloadStore(Repo::all);
+    } else {
+      refresh(affected);
+    }
+    resetPending();
+    if (fingerprinted) {
+      saveSnapshot(fingerprint);
+    }
+  }
+  if (graphEnabled_) {
+    startLoadingGraph();
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+// Follow the dependencies returned by the given backend query, either
+// getDependencies() or getDependents(), from the given origins and
+// return all the origins that were reached, including the initial ones.
+// The dependency graph answers instead of the backend once it is loaded.
+std::vector<std::string> Pkg::getDependencyClosure(DependencyQuery query,
+                                                   const std::vector<std::string>& origins) const {
+  std::set<std::string> visited(origins.begin(), origins.end());
+
+  bool forward = query == &Backend::getDependencies;
+  const DependencyGraph& graph = forward ? remoteGraph_ : localGraph_;
+  if (!graph.empty()) {
+    std::vector<DependencyGraph::Node> ids;
+    for (const auto& origin : origins) {
+      PkgId id;
+      if (store_.find(origin, id)) {
+        ids.push_back(id);
       }
     }
+    auto reached = graph.closure(ids, forward ? DependencyGraph::Direction::dependencies
+                                              : DependencyGraph::Direction::dependents);
+    for (auto& origin : getOrigins(reached)) {
+      visited.insert(std::move(origin));
+    }
+
+    return std::vector<std::string>(visited.begin(), visited.end());
   }
 
-  if (!remove.empty()) {
-    execPkg("delete -qy" + remove);
+  std::vector<std::string> frontier(origins);
+  while (!frontier.empty() && visited.size() <= maxRefreshedPorts) {
+    std::vector<std::string> next;
+    for (auto& origin : ((*backend_).*query)(frontier)) {
+      if (visited.insert(origin).second) {
+        next.push_back(std::move(origin));
+      }
+    }
+    frontier.swap(next);
   }
-  if (!install.empty()) {
-    execPkg("install -qy" + install);
+
+  return std::vector<std::string>(visited.begin(), visited.end());
+}
+
+// Read the dependency edges of both catalogues in the background. If a
+// query is already running, the packages may have changed since it was
+// started, so another one follows it.
+void Pkg::startLoadingGraph() {
+  graphEnabled_ = true;
+  if (graphEdges_.valid()) {
+    graphStale_ = true;
+    return;
   }
-  if (!remove.empty() || !install.empty()) {
-    reload();
-    resetPending();
+
+  graphStale_ = false;
+  Backend* backend = backend_.get();
+  graphEdges_ = std::async(std::launch::async, [backend]() {
+      DependencyEdges edges;
+      edges.local = backend->getDependencyEdges(Backend::Catalogue::local);
+      edges.remote = backend->getDependencyEdges(Backend::Catalogue::remote);
+      return edges;
+    });
+}
+
+// Build the dependency graphs out of the edges read in the background,
+// and return true if they changed. Without edges, removals and installs
+// cannot be analyzed, but transactions still query the backend.
+bool Pkg::mergeDependencyGraph() {
+  if (!graphEdges_.valid() || isLoading()
+      || graphEdges_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+    return false;
+  }
+
+  try {
+    DependencyEdges edges = graphEdges_.get();
+    buildGraph(localGraph_, edges.local);
+    buildGraph(remoteGraph_, edges.remote);
+    syslog(LOG_INFO, "Pkg::mergeDependencyGraph(): %zu local and %zu remote dependencies",
+           localGraph_.numEdges(), remoteGraph_.numEdges());
+  }
+  catch (std::exception& e) {
+    syslog(LOG_WARNING, "Pkg::mergeDependencyGraph(): %s", e.what());
+    localGraph_.clear();
+    remoteGraph_.clear();
+  }
+  if (graphStale_) {
+    startLoadingGraph();
+  }
+
+  return true;
+}
+
+void Pkg::buildGraph(DependencyGraph& graph, const Backend::Edges& edges) {
+  std::vector<DependencyGraph::Edge> ids;
+  ids.reserve(edges.size());
+  for (const auto& edge : edges) {
+    PkgId from, to;
+    if (store_.find(edge.first, from) && store_.find(edge.second, to)) {
+      ids.emplace_back(from, to);
+    }
+  }
+  graph.build(store_.size(), ids);
+}
+
+std::vector<std::string> Pkg::getOrigins(const std::vector<DependencyGraph::Node>& ids) const {
+  std::vector<std::string> origins;
+  origins.reserve(ids.size());
+  for (const auto& id : ids) {
+    if (id < store_.size()) {
+      origins.push_back(store_.text(id, Store::Text::origin));
+    }
+  }
+  std::sort(origins.begin(), origins.end());
+
+  return origins;
+}
+
+// Installed ports that would be removed together with the given one, as
+// they depend on it, directly or not.
+std::vector<std::string> Pkg::getRemovalImpact(PkgId id) const {
+  checkId(id);
+  return getOrigins(localGraph_.closure({id},
+                                        DependencyGraph::Direction::dependents,
+                                        [this](DependencyGraph::Node node) {
+                                          return node < store_.size()
+                                            && store_.hasStatus(node, Statuses::installed);
+                                        }));
+}
+
+// Missing dependencies that would be installed together with the given
+// port. Those of installed ports are assumed to be satisfied already.
+std::vector<std::string> Pkg::getInstallImpact(PkgId id) const {
+  checkId(id);
+  return getOrigins(remoteGraph_.closure({id},
+                                         DependencyGraph::Direction::dependencies,
+                                         [this](DependencyGraph::Node node) {
+                                           return node < store_.size()
+                                             && !store_.hasStatus(node, Statuses::installed);
+                                         }));
+}
+
+// Query the local state of the given origins only, and patch their
+// status and local version in place. The rest of the repository, and
+// hence the identifiers known by the user interface, are left as is.
+void Pkg::refresh(const std::vector<std::string>& origins) {
+  std::vector<Port> pkgs = backend_->getPorts(Backend::Catalogue::local,
+                                                origins,
+                                                !lazyDescriptions_);
+  patchPorts(Repo::local, origins, pkgs);
+}
+
+// Replace what the given repository tells about the given origins with
+// the ports found there, the origins missing from pkgs being no longer
+// installed, or no longer available.
+void Pkg::patchPorts(Repo repo, const std::vector<std::string>& origins, std::vector<Port>& pkgs) {
+  for (const auto& origin : origins) {
+    PkgId id;
+    if (!store_.find(origin, id)) {
+      continue;
+    }
+    if (repo == Repo::local) {
+      store_.setStatus(id, Statuses::installed, false);
+      store_.setText(id, Store::Text::localVersion, std::string());
+      // A port only known locally, once removed, is kept with no status
+      // until the next full reload.
+      if (store_.hasText(id, Store::Text::remoteVersion)) {
+        store_.setStatus(id, Statuses::available);
+      }
+    } else {
+      store_.setStatus(id, Statuses::available, false);
+      store_.setText(id, Store::Text::remoteVersion, std::string());
+    }
+  }
+
+  size_t numPorts = store_.size();
+  fillPkgRepo(repo, pkgs);
+  if (store_.size() != numPorts) {
+    store_.sort();
+  }
+
+  for (const auto& origin : origins) {
+    PkgId id;
+    if (store_.find(origin, id)) {
+      updateUpgradeStatus(id);
+    }
+  }
+  for (const auto& port : pkgs) {
+    PkgId id;
+    if (store_.find(port.origin, id)) {
+      indexPort(id);
+    }
+  }
+}
+
+// Start polling the fingerprints of the catalogues in the background,
+// if the backend provides them.
+void Pkg::startWatching() {
+  uint64_t fingerprint;
+  if (watcher_.joinable() || !backend_->getFingerprint(Backend::Catalogue::local, fingerprint)) {
+    return;
+  }
+  watcher_ = std::thread(&Pkg::watchCatalogues, this);
+}
+
+// Body of the watcher thread. Whenever the fingerprint of a catalogue
+// changes, its versions are compared with the store, and only the ports
+// that differ are read again and queued, to be patched in by
+// applyCatalogueChanges(). Transactions run by performPending() refresh
+// the store themselves, and a store being loaded cannot be compared, so
+// the catalogues are left alone meanwhile.
+void Pkg::watchCatalogues() {
+  static const Backend::Catalogue catalogues[] = {Backend::Catalogue::local,
+                                                  Backend::Catalogue::remote};
+  const size_t numCatalogues = sizeof(catalogues) / sizeof(catalogues[0]);
+  uint64_t fingerprints[numCatalogues] = {};
+  for (size_t i = 0; i < numCatalogues; ++i) {
+    backend_->getFingerprint(catalogues[i], fingerprints[i]);
+  }
+
+  std::unique_lock<std::mutex> lock(watchMutex_);
+  for (;;) {
+    watchCond_.wait_for(lock, watchInterval);
+    if (watcherStop_) {
+      break;
+    }
+    if (transacting_ || loading_) {
+      continue;
+    }
+    unsigned int generation = watchGeneration_;
+    lock.unlock();
+
+    // The catalogues changed in a round are queued together, with the
+    // fingerprint taken before any of them was read, which a catalogue
+    // that could not be read invalidates.
+    uint64_t roundFingerprint;
+    bool fingerprinted = getCatalogueFingerprint(roundFingerprint);
+    std::vector<ChangedCatalogue> round;
+    for (size_t i = 0; i < numCatalogues; ++i) {
+      uint64_t fingerprint;
+      if (!backend_->getFingerprint(catalogues[i], fingerprint) || fingerprint == fingerprints[i]) {
+        continue;
+      }
+      fingerprints[i] = fingerprint;
+
+      Repo repo = catalogues[i] == Backend::Catalogue::local ? Repo::local : Repo::remote;
+      ChangedCatalogue changed {catalogues[i], std::vector<std::string>(), std::vector<Port>(),
+                                generation, roundFingerprint, fingerprinted};
+      try {
+        changed.origins = getChangedOrigins(repo, backend_->getVersions(catalogues[i]));
+        if (changed.origins.empty()) {
+          continue;
+        }
+        changed.ports = backend_->getPorts(catalogues[i], changed.origins, !lazyDescriptions_);
+      }
+      catch (std::exception& e) {
+        syslog(LOG_WARNING, "Pkg::watchCatalogues(): %s", e.what());
+        fingerprinted = false;
+        continue;
+      }
+      round.push_back(std::move(changed));
+    }
+
+    lock.lock();
+    if (generation == watchGeneration_) {
+      for (auto& changed : round) {
+        changed.fingerprinted = fingerprinted;
+        changedCatalogues_.push_back(std::move(changed));
+      }
+    }
+  }
+}
+
+// Origins whose version in the given catalogue differs from the store,
+// added to the catalogue or missing from it. Called from the watcher
+// thread, which only reads the store.
+std::vector<std::string> Pkg::getChangedOrigins(Repo repo, const Backend::Versions& versions) {
+  Store::Text versionText = repo == Repo::local ? Store::Text::localVersion
+                                                : Store::Text::remoteVersion;
+  std::unordered_set<std::string_view> listed;
+  std::vector<std::string> origins;
+  std::shared_lock<std::shared_mutex> storeLock(storeMutex_);
+  for (const auto& port : versions) {
+    listed.insert(port.first);
+    PkgId id;
+    if (!store_.find(port.first, id)
+        || (repo == Repo::local && !store_.hasStatus(id, Statuses::installed))
+        || store_.textView(id, versionText) != port.second) {
+      origins.push_back(port.first);
+    }
+  }
+  for (PkgId id = 0; id < store_.size(); ++id) {
+    if (store_.hasText(id, versionText)
+        && (repo == Repo::remote || store_.hasStatus(id, Statuses::installed))) {
+      std::string_view origin = store_.textView(id, Store::Text::origin);
+      if (listed.find(origin) == listed.end()) {
+        origins.emplace_back(origin);
+      }
+    }
+  }
+
+  return origins;
+}
+
+void Pkg::setTransacting(bool transacting) {
+  std::lock_guard<std::mutex> lock(watchMutex_);
+  transacting_ = transacting;
+  ++watchGeneration_;
+  changedCatalogues_.clear();
+}
+
+void Pkg::setLoading(bool loading) {
+  std::lock_guard<std::mutex> lock(watchMutex_);
+  loading_ = loading;
+  ++watchGeneration_;
+  changedCatalogues_.clear();
+}
+
+// Patch in place the ports the watcher thread found to differ from the
+// store. Return true if the store changed. Nothing is applied until
+// loading is over.
+bool Pkg::applyCatalogueChanges() {
+  if (isLoading()) {
+    return false;
+  }
+
+  std::deque<ChangedCatalogue> changedCatalogues;
+  {
+    std::lock_guard<std::mutex> lock(watchMutex_);
+    changedCatalogues.swap(changedCatalogues_);
+  }
+
+  bool changed = false;
+  bool fingerprinted = false;
+  uint64_t fingerprint = 0;
+  std::unique_lock<std::shared_mutex> storeLock;
+  for (auto& catalogue : changedCatalogues) {
+    fingerprinted = catalogue.fingerprinted;
+    fingerprint = catalogue.fingerprint;
+    Repo repo = catalogue.catalogue == Backend::Catalogue::local ? Repo::local : Repo::remote;
+    syslog(LOG_INFO, "Pkg::applyCatalogueChanges(): %zu %s packages changed",
+           catalogue.origins.size(), repo == Repo::local ? "local" : "remote");
+    if (!storeLock.owns_lock()) {
+      storeLock = lockStore();
+    }
+    patchPorts(repo, catalogue.origins, catalogue.ports);
+    changed = true;
+  }
+
+  if (changed) {
+    if (fingerprinted) {
+      saveSnapshot(fingerprint);
+    }
+    if (graphEnabled_) {
+      startLoadingGraph();
+    }
+  }
+
+  return changed;
+}
+
+// Have saver_ write the store to the snapshot, under the fingerprint the
+// catalogues had before they were read. The store must be locked.
+void Pkg::saveSnapshot(uint64_t fingerprint) {
+  if (!useSnapshot_ || getSnapshotPath().empty()) {
+    return;
+  }
+
+  store_.flushDescriptions();
+  std::lock_guard<std::mutex> lock(saveMutex_);
+  saveRequest_.fingerprint = fingerprint;
+  saveRequest_.statuses = store_.persistentStatuses();
+  saveQueued_ = true;
+  if (!saver_.joinable()) {
+    saver_ = std::thread(&Pkg::saveSnapshots, this);
+  }
+  saveCond_.notify_all();
+}
+
+// Body of the saver thread. A snapshot is only written if the catalogues
+// did not change since they were read, as it would otherwise hold stale
+// ports under a fingerprint that looks valid. The latest request is
+// still written when portal exits.
+void Pkg::saveSnapshots() {
+  std::unique_lock<std::mutex> lock(saveMutex_);
+  for (;;) {
+    saveCond_.wait(lock, [this]() {return saverStop_ || saveQueued_;});
+    if (!saveQueued_) {
+      return;
+    }
+    SnapshotRequest request = std::move(saveRequest_);
+    saveQueued_ = false;
+    lock.unlock();
+
+    std::string snapshotPath = getSnapshotPath();
+    uint64_t fingerprint;
+    {
+      std::shared_lock<std::shared_mutex> storeLock(storeMutex_);
+      if (!getCatalogueFingerprint(fingerprint) || fingerprint != request.fingerprint) {
+        syslog(LOG_INFO, "Pkg::saveSnapshots(): catalogues changed while read, not saved");
+      } else if (request.statuses.size() == store_.size()) {
+        try {
+          if (!store_.save(snapshotPath, request.fingerprint, request.statuses)) {
+            syslog(LOG_WARNING, "Pkg::saveSnapshots(): could not save snapshot to [%s]",
+                   snapshotPath.c_str());
+          }
+        }
+        catch (std::exception& e) {
+          syslog(LOG_ERR, "%s", e.what());
+        }
+      }
+    }
+
+    lock.lock();
   }
 }
 
 void Pkg::resetPending() {
-  for (const auto& category : refPkgs_) {
-    for (const auto& port : category.second) {
-      port.status.reset(pendingInstall);
-      port.status.reset(pendingRemoval);
+  store_.resetStatus(pendingInstall);
+  store_.resetStatus(pendingRemoval);
+}
+
+// Search the origins, comments and descriptions of the ports for an
+// extended regular expression, ignoring case as pkg-search(8) does, and
+// using the same regex(3) matching. Results of recent searches are
+// reused, as are the matches of a plain string the pattern extends.
+void Pkg::search(const std::string& pattern) {
+  std::vector<PkgId> ids;
+  std::vector<PkgId> within;
+  bool exact = false;
+  bool narrowed = false;
+  {
+    std::lock_guard<std::mutex> lock(searchMutex_);
+    const SearchResults* cached = findCachedSearch(pattern, exact);
+    if (cached != nullptr) {
+      (exact ? ids : within) = cached->ids;
+      narrowed = !exact;
     }
   }
+
+  if (!exact) {
+    findMatches(pattern, narrowed ? &within : nullptr, nullptr, ids);
+    std::lock_guard<std::mutex> lock(searchMutex_);
+    cacheSearch(pattern, ids);
+  }
+  fillTmpRepo(ids);
 }
 
-void Pkg::search(const std::string & search) {
-  std::string args = "search -o ";
-  args.append(search);
-  std::vector<Port> pkgs = runPkgSearch(args);
-  fillTmpRepo(pkgs);
+// Search in the background, so that the caller is not kept waiting:
+// mergeSearchResults() shows the matches once found. Cached results are
+// shown at once instead, in which case true is returned. A search still
+// running is abandoned, its results being stale.
+bool Pkg::startSearch(const std::string& pattern) {
+  std::lock_guard<std::mutex> lock(searchMutex_);
+  ++searchGeneration_;
+  searchReady_ = false;
+
+  bool exact;
+  const SearchResults* cached = findCachedSearch(pattern, exact);
+  if (cached != nullptr && exact) {
+    searchQueued_ = false;
+    searchPending_ = false;
+    fillTmpRepo(cached->ids);
+    return true;
+  }
+
+  searchQuery_ = pattern;
+  searchQueued_ = true;
+  searchPending_ = true;
+  if (!searcher_.joinable()) {
+    searcher_ = std::thread(&Pkg::runSearches, this);
+  }
+  searchCond_.notify_all();
+
+  return false;
+}
+
+bool Pkg::isSearching() const {
+  std::lock_guard<std::mutex> lock(searchMutex_);
+  return searchPending_;
+}
+
+// Show the matches found by the searcher since the last call, and
+// return true if there were any.
+bool Pkg::mergeSearchResults() {
+  std::lock_guard<std::mutex> lock(searchMutex_);
+  if (!searchReady_) {
+    return false;
+  }
+  searchReady_ = false;
+  searchPending_ = false;
+  fillTmpRepo(searchResults_.ids);
+
+  return true;
+}
+
+void Pkg::cancelSearch() {
+  std::lock_guard<std::mutex> lock(searchMutex_);
+  ++searchGeneration_;
+  searchQueued_ = false;
+  searchPending_ = false;
+  searchReady_ = false;
+}
+
+// Body of the searcher thread, which runs the latest query started.
+// Matching is done without holding searchMutex_, so that queries can
+// be started meanwhile, but holding the store shared.
+void Pkg::runSearches() {
+  std::unique_lock<std::mutex> lock(searchMutex_);
+  for (;;) {
+    searchCond_.wait(lock, [this]() {return searchQueued_ || searcherStop_;});
+    if (searcherStop_) {
+      return;
+    }
+    std::string pattern = searchQuery_;
+    unsigned int generation = searchGeneration_;
+    searchQueued_ = false;
+
+    bool exact;
+    const SearchResults* cached = findCachedSearch(pattern, exact);
+    std::vector<PkgId> within;
+    bool narrowed = cached != nullptr;
+    if (narrowed) {
+      within = cached->ids;
+    }
+    std::vector<PkgId> ids;
+    bool found = exact;
+    if (exact) {
+      ids.swap(within);
+    } else {
+      lock.unlock();
+      {
+        std::shared_lock<std::shared_mutex> storeLock(storeMutex_);
+        found = findMatches(pattern, narrowed ? &within : nullptr, &generation, ids);
+      }
+      lock.lock();
+    }
+
+    if (found && generation == searchGeneration_) {
+      cacheSearch(pattern, ids);
+      searchResults_.pattern = pattern;
+      searchResults_.ids.swap(ids);
+      searchReady_ = true;
+    }
+  }
+}
+
+// Match the pattern against the ports preselected with the trigram
+// index using the literals the expression contains, or against those
+// listed in within if given and fewer. Patterns with no special character,
+// or which are not valid expressions, are looked for as plain strings.
+// If a generation is given, matching is abandoned and false returned
+// once searchGeneration_ differs from it.
+bool Pkg::findMatches(const std::string& pattern,
+                      const std::vector<PkgId>* within,
+                      const unsigned int* generation,
+                      std::vector<PkgId>& ids) {
+  auto start = std::chrono::steady_clock::now();
+
+  regex_t regex;
+  bool isRegex = !isPlainPattern(pattern)
+    && regcomp(&regex, pattern.c_str(), REG_EXTENDED | REG_ICASE | REG_NOSUB) == 0;
+
+  std::vector<std::string> literals;
+  if (isRegex) {
+    literals = TrigramIndex::regexLiterals(pattern);
+  } else {
+    literals.push_back(pattern);
+  }
+
+  buildSearchIndex();
+  std::vector<TrigramIndex::DocId> candidates;
+  bool preselected;
+  {
+    std::lock_guard<std::mutex> lock(indexMutex_);
+    preselected = searchIndex_.candidates(literals, candidates);
+  }
+  if (within != nullptr && (!preselected || within->size() < candidates.size())) {
+    candidates = *within;
+  } else if (!preselected) {
+    candidates.resize(store_.size());
+    std::iota(candidates.begin(), candidates.end(), 0);
+  }
+
+  ids.clear();
+  bool cancelled = false;
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    if (generation != nullptr && i % searchCheckInterval == 0
+        && searchGeneration_ != *generation) {
+      cancelled = true;
+      break;
+    }
+    for (const auto& text : getSearchableTexts(candidates[i])) {
+      if (isRegex ? regexec(&regex, text.c_str(), 0, nullptr, 0) == 0
+                  : containsIgnoringCase(text, pattern)) {
+        ids.push_back(candidates[i]);
+        break;
+      }
+    }
+  }
+  if (isRegex) {
+    regfree(&regex);
+  }
+  if (cancelled) {
+    return false;
+  }
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  syslog(LOG_INFO, "Pkg::findMatches(): %zu matches out of %zu candidates in %.3fs",
+         ids.size(), candidates.size(), elapsed.count());
+
+  return true;
+}
+
+// Look for the results of the given pattern, moving them to the front
+// of the cache, or else for those of the longest plain string the
+// pattern extends, which hold all of its matches. Called with
+// searchMutex_ held.
+const Pkg::SearchResults* Pkg::findCachedSearch(const std::string& pattern, bool& exact) {
+  exact = false;
+  const SearchResults* narrowest = nullptr;
+  for (auto it = searchCache_.begin(); it != searchCache_.end(); ++it) {
+    if (it->pattern == pattern) {
+      searchCache_.splice(searchCache_.begin(), searchCache_, it);
+      exact = true;
+      return &searchCache_.front();
+    }
+    if (isPlainPattern(pattern) && isPlainPattern(it->pattern)
+        && pattern.find(it->pattern) != std::string::npos
+        && (narrowest == nullptr || it->pattern.length() > narrowest->pattern.length())) {
+      narrowest = &*it;
+    }
+  }
+
+  return narrowest;
+}
+
+// Called with searchMutex_ held
+void Pkg::cacheSearch(const std::string& pattern, const std::vector<PkgId>& ids) {
+  auto it = std::find_if(searchCache_.begin(), searchCache_.end(),
+                         [&pattern](const SearchResults& results) {
+                           return results.pattern == pattern;
+                         });
+  if (it != searchCache_.end()) {
+    searchCache_.erase(it);
+  }
+  searchCache_.push_front({pattern, ids});
+  if (searchCache_.size() > maxCachedSearches) {
+    searchCache_.pop_back();
+  }
+}
+
+// Exclusive access to the store, for changing it. A search running in
+// the background gives up first, and the results of the previous ones
+// are dropped, as they would not match the store anymore.
+std::unique_lock<std::shared_mutex> Pkg::lockStore() {
+  {
+    std::lock_guard<std::mutex> lock(searchMutex_);
+    ++searchGeneration_;
+    searchQueued_ = false;
+    searchPending_ = false;
+    searchReady_ = false;
+    searchCache_.clear();
+  }
+
+  return std::unique_lock<std::shared_mutex>(storeMutex_);
+}
+
+// Texts of a port looked up by search(). Descriptions loaded on demand
+// are only searched once they were fetched.
+std::vector<std::string> Pkg::getSearchableTexts(PkgId id) const {
+  std::vector<std::string> texts;
+  texts.push_back(store_.text(id, Store::Text::origin));
+  texts.push_back(store_.text(id, Store::Text::comment));
+  if (!lazyDescriptions_) {
+    texts.push_back(store_.text(id, Store::Text::description));
+  } else {
+    std::lock_guard<std::mutex> lock(descrMutex_);
+    auto it = descriptions_.find(id);
+    if (it != descriptions_.end()) {
+      texts.push_back(it->second);
+    }
+  }
+
+  return texts;
+}
+
+// The index is only built by the first search following a reload, so
+// that the packages list is displayed as soon as it is loaded.
+void Pkg::resetSearchIndex() {
+  std::lock_guard<std::mutex> lock(indexMutex_);
+  searchIndex_.clear();
+  searchIndexBuilt_ = false;
+}
+
+void Pkg::buildSearchIndex() {
+  std::lock_guard<std::mutex> descrLock(descrMutex_);
+  std::lock_guard<std::mutex> indexLock(indexMutex_);
+  if (searchIndexBuilt_) {
+    return;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  searchIndex_.clear();
+  for (PkgId id = 0; id < store_.size(); ++id) {
+    addToSearchIndex(id);
+  }
+  for (const auto& description : descriptions_) {
+    searchIndex_.add(description.first, description.second);
+  }
+  searchIndexBuilt_ = true;
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  syslog(LOG_INFO, "Pkg::buildSearchIndex(): indexed %zu packages in %.3fs",
+         store_.size(), elapsed.count());
+}
+
+void Pkg::indexPort(PkgId id) {
+  std::lock_guard<std::mutex> lock(indexMutex_);
+  if (searchIndexBuilt_) {
+    addToSearchIndex(id);
+  }
+}
+
+void Pkg::addToSearchIndex(PkgId id) {
+  searchIndex_.add(id, store_.text(id, Store::Text::origin));
+  searchIndex_.add(id, store_.text(id, Store::Text::comment));
+  if (!lazyDescriptions_) {
+    searchIndex_.add(id, store_.text(id, Store::Text::description));
+  }
 }
 
 void Pkg::resetFilter() {
   switchToReferenceRepository();
 }
 
+// Combine the bitmaps of the wanted statuses a word at a time for each
+// category. As they are indexed by position, the set bits directly give
+// the matching ports in the expected order.
 void Pkg::applyFilter(const Status& wantedStatuses) {
-  std::vector<Port> pkgs;
-  for (const auto& category : refPkgs_) {
-    for (const auto& pkg : category.second) {
-      if ((pkg.status & wantedStatuses).any()) {
-        pkgs.push_back(pkg);
+  clearTmpRepo();
+  const Selection& members = store_.members();
+  Bitmap matches;
+  for (CategoryId category = 0; category < members.size(); ++category) {
+    matches.clear();
+    matches.resize(members[category].size());
+    for (size_t bit = 0; bit < numStatuses; ++bit) {
+      if (wantedStatuses[bit]) {
+        matches |= store_.statusBitmap(category, static_cast<Statuses>(bit));
+      }
+    }
+    std::vector<PkgId>& selection = tmpPkgs_[category];
+    matches.forEach([&](size_t position) {
+        selection.push_back(members[category][position]);
+      });
+  }
+  switchToTemporaryRepository();
+}
+
+void Pkg::prefetchDescriptions(const std::vector<PkgId>& ids) {
+  if (!lazyDescriptions_) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(descrMutex_);
+  bool queued = false;
+  for (const auto& id : ids) {
+    if (id < store_.size()
+        && descriptions_.find(id) == descriptions_.end()
+        && descrQueued_.insert(id).second) {
+      descrRequests_.emplace_back(id, store_.text(id, Store::Text::origin));
+      queued = true;
+    }
+  }
+  if (queued) {
+    descrCond_.notify_all();
+  }
+}
+
+// Return the description of a port, or an empty one if the loader
+// thread did not fetch it yet, in which case it is asked to. The request
+// is put in front of the queue, so it gets served before the prefetched
+// neighbours. isDescriptionLoaded() tells when it is available.
+std::string Pkg::getDescription(PkgId id) const {
+  std::lock_guard<std::mutex> lock(descrMutex_);
+
+  auto it = descriptions_.find(id);
+  if (it == descriptions_.end()) {
+    descrQueued_.insert(id);
+    descrRequests_.emplace_front(id, store_.text(id, Store::Text::origin));
+    descrCond_.notify_all();
+    return std::string();
+  }
+
+  return it->second;
+}
+
+bool Pkg::isDescriptionLoaded(PkgId id) const {
+  if (!lazyDescriptions_) {
+    return true;
+  }
+
+  std::lock_guard<std::mutex> lock(descrMutex_);
+  return descriptions_.find(id) != descriptions_.end();
+}
+
+bool Pkg::isLoadingDescriptions() const {
+  if (!lazyDescriptions_) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(descrMutex_);
+  return !descrQueued_.empty();
+}
+
+void Pkg::resetDescriptions() {
+  if (!lazyDescriptions_) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(descrMutex_);
+    descriptions_.clear();
+    descrRequests_.clear();
+    descrQueued_.clear();
+    ++descrGeneration_;
+  }
+  if (!descrLoader_.joinable()) {
+    descrLoader_ = std::thread(&Pkg::loadDescriptions, this);
+  }
+}
+
+// Body of the loader thread: fetch the queued descriptions by batches,
+// from the remote repositories first, and from the local database for
+// the ports which are not available remotely. Results obtained for an
+// older generation of identifiers, before a reload, are discarded.
+void Pkg::loadDescriptions() {
+  std::unique_lock<std::mutex> lock(descrMutex_);
+
+  for (;;) {
+    descrCond_.wait(lock, [this]() {
+        return descrLoaderStop_ || !descrRequests_.empty();
+      });
+    if (descrLoaderStop_) {
+      return;
+    }
+
+    std::unordered_map<std::string, PkgId> batch;
+    while (!descrRequests_.empty() && batch.size() < descriptionsBatchSize) {
+      if (descriptions_.find(descrRequests_.front().first) == descriptions_.end()) {
+        batch.emplace(descrRequests_.front().second, descrRequests_.front().first);
+      }
+      descrRequests_.pop_front();
+    }
+    unsigned int generation = descrGeneration_;
+    lock.unlock();
+
+    std::unordered_map<PkgId, std::string> results;
+    try {
+      for (auto catalogue : {Backend::Catalogue::remote, Backend::Catalogue::local}) {
+        std::vector<std::string> origins;
+        for (const auto& request : batch) {
+          if (results.find(request.second) == results.end()) {
+            origins.push_back(request.first);
+          }
+        }
+        if (origins.empty()) {
+          break;
+        }
+        for (auto& port : backend_->getPorts(catalogue, origins, true)) {
+          auto request = batch.find(port.origin);
+          if (request != batch.end()) {
+            results[request->second] = std::move(port.description);
+          }
+        }
+      }
+    }
+    catch (std::exception& e) {
+      syslog(LOG_ERR, "%s", e.what());
+    }
+
+    lock.lock();
+    if (generation == descrGeneration_) {
+      // Ports whose description could not be fetched get an empty one,
+      // so that nobody keeps waiting for them.
+      std::lock_guard<std::mutex> indexLock(indexMutex_);
+      for (const auto& request : batch) {
+        searchIndex_.add(request.second, results[request.second]);
+        descriptions_.emplace(request.second, std::move(results[request.second]));
+        descrQueued_.erase(request.second);
       }
+      // Descriptions fetched since may match cached searches
+      std::lock_guard<std::mutex> searchLock(searchMutex_);
+      searchCache_.clear();
     }
+    descrCond_.notify_all();
   }
-  fillTmpRepo(pkgs);
 }
 
 }
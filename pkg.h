@@ -26,12 +26,32 @@
 
 #pragma once
 
+#include <cstdint>
+#include <chrono>
+#include <exception>
 #include <string>
-#include <tuple>
+#include <string_view>
 #include <bitset>
 #include <vector>
-#include <set>
-#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <condition_variable>
+#include <thread>
+#include <memory>
+#include <future>
+
+#include "backend.h"
+#include "bitmap.h"
+#include "depgraph.h"
+#include "descriptionstore.h"
+#include "textarena.h"
+#include "trigramindex.h"
+#include "version.h"
 
 namespace portal {
 
@@ -60,75 +80,367 @@ class Pkg {
     available,
     installed,
     upgradable,
+    downgradable,
     pendingInstall,
     pendingRemoval,
     numStatuses
   };
 
   using Status = std::bitset<numStatuses>;
+  using PkgId = unsigned int;
+  using CategoryId = unsigned int;
 
   static Pkg&    instance() {static Pkg instance_; return instance_;}
 
-  bool                      isRepositoryEmpty() const {return pkgs_->empty();}
+  bool                      isRepositoryEmpty() const;
   std::vector<std::string>  getPkgOrigins() const;
   std::vector<std::string>  getPkgOrigins(const std::string& category) const;
-  std::string               getNameFromOrigin(const std::string& origin) const;
+  const std::vector<PkgId>& getPkgIds(const std::string& category) const;
+  PkgId                     getPkgId(const std::string& origin) const;
+  static std::string_view   getNameFromOrigin(std::string_view origin);
+  static std::string_view   getCategoryFromOrigin(std::string_view origin);
   std::string               getLocalVersion(const std::string& origin) const;
+  std::string               getLocalVersion(PkgId id) const;
   std::string               getRemoteVersion(const std::string& origin) const;
+  std::string               getRemoteVersion(PkgId id) const;
   std::vector<std::string>  getPkgCategories() const;
   unsigned int              getCategorySize(const std::string& category) const;
   std::string               getPkgAttr(const std::string& origin, Attr attr) const;
+  std::string               getPkgAttr(PkgId id, Attr attr) const;
+
+  // Views into the storage of the packages, which stay valid until the
+  // packages change. Descriptions are compressed, and only available
+  // through getPkgAttr().
+  const std::vector<CategoryId>&  getCategoryIds() const;
+  std::string_view                getCategoryName(CategoryId category) const;
+  const std::vector<PkgId>&       getPkgIds(CategoryId category) const;
+  std::string_view                getPkgAttrView(PkgId id, Attr attr) const;
+
   void                      reload(Repo repo = Repo::all);
+  void                      startLoading();
+  bool                      isLoading() const {return loader_.joinable();}
+  bool                      mergeLoadedPorts();
+  void                      startWatching();
+  bool                      isWatching() const {return watcher_.joinable();}
+  bool                      applyCatalogueChanges();
+  bool                      isLoadingGraph() const {return graphEdges_.valid();}
+  bool                      mergeDependencyGraph();
+  std::vector<std::string>  getRemovalImpact(PkgId id) const;
+  std::vector<std::string>  getInstallImpact(PkgId id) const;
   void                      registerInstall(const std::string& origin);
+  void                      registerInstall(PkgId id);
   void                      registerRemoval(const std::string& origin);
+  void                      registerRemoval(PkgId id);
   void                      performPending();
-  void                      search(const std::string& args);
+  const Progress&           getProgress() const {return progress_;}
+  void                      search(const std::string& pattern);
+  bool                      startSearch(const std::string& pattern);
+  bool                      isSearching() const;
+  bool                      mergeSearchResults();
+  void                      cancelSearch();
   void                      resetFilter();
   void                      applyFilter(const Status& wantedStatuses);
   std::string               getCurrentStatusAsString(const std::string& origin) const;
+  std::string               getCurrentStatusAsString(PkgId id) const;
   std::string               getPendingStatusAsString(const std::string& origin) const;
+  std::string               getPendingStatusAsString(PkgId id) const;
   bool                      hasPendingActions(const std::string& origin) const;
+  bool                      hasPendingActions(PkgId id) const;
   bool                      isUpgradable(const std::string& origin) const;
-  bool                      gotRootPrivileges() const {return rootPrivileges_;}
+  bool                      isUpgradable(PkgId id) const;
+  bool                      isDowngradable(const std::string& origin) const;
+  bool                      isDowngradable(PkgId id) const;
+  bool                      gotRootPrivileges() const {return backend_->canModify();}
+  void                      setBackend(std::unique_ptr<Backend> backend);
+  void                      setUseSnapshot(bool useSnapshot) {useSnapshot_ = useSnapshot;}
+  void                      setLazyDescriptions(bool lazy) {lazyDescriptions_ = lazy;}
+  void                      prefetchDescriptions(const std::vector<PkgId>& ids);
+  bool                      isDescriptionLoaded(PkgId id) const;
+  bool                      isLoadingDescriptions() const;
 
  private:
-  struct Port {
-    mutable Status          status;
-    mutable std::string     localVersion;
-    mutable std::string     remoteVersion;
+  using Port = Backend::Port;
+  using DependencyQuery = Backend::Origins (Backend::*)(const Backend::Origins&);
+
+  // Column-oriented storage of the packages. Each attribute is kept in
+  // its own contiguous array indexed by PkgId, and all the strings are
+  // appended to a single text arena. Ports of a given category are
+  // listed in members(), sorted by origin once sort() was called, and
+  // position() tells where a port stands in the list of its category.
+  // Statuses are kept as one bitmap per status value, indexed by PkgId,
+  // and mirrored in one bitmap per category indexed by position.
+  // Versions are also kept decomposed, to be compared cheaply.
+  // Descriptions are deduplicated and compressed apart from the other
+  // texts, their references holding a DescriptionStore handle instead
+  // of an arena offset.
+  // The store can be saved to a snapshot file, and loaded back by
+  // mapping it in memory: texts are then served from the mapping.
+  // Category names are never moved once interned, so that views of them
+  // remain valid as ports are added.
+  class Store {
+   public:
+    Store() {}
+    ~Store();
+
+    enum Text {
+      origin,
+      comment,
+      description,
+      localVersion,
+      remoteVersion,
+      numTexts
+    };
+
+    bool                        empty() const {return category_.empty();}
+    size_t                      size() const {return category_.size();}
+    void                        clear();
+    PkgId                       insert(const std::string& origin, bool& inserted);
+    bool                        find(const std::string& origin, PkgId& id) const;
+    void                        sort();
+    Status                      status(PkgId id) const;
+    bool                        hasStatus(PkgId id, Statuses bit) const {return statuses_[bit].test(id);}
+    void                        setStatus(PkgId id, Statuses bit, bool value = true);
+    void                        setStatus(PkgId id, const Status& status);
+    void                        resetStatus(Statuses bit);
+    const Bitmap&               statusBitmap(Statuses bit) const {return statuses_[bit];}
+    const Bitmap&               statusBitmap(CategoryId category, Statuses bit) const {
+      return categoryStatuses_[bit][category];
+    }
+    CategoryId                  category(PkgId id) const {return category_[id];}
+    std::string                 text(PkgId id, Text column) const;
+    std::string_view            textView(PkgId id, Text column) const;
+    std::string_view            name(PkgId id) const;
+    bool                        hasText(PkgId id, Text column) const {return texts_[column][id].length != 0;}
+    bool                        sameText(PkgId id, Text column, Text other) const;
+    void                        setText(PkgId id, Text column, const std::string& text);
+    int                         compareVersions(PkgId id) const;
+    bool                        findCategory(const std::string& name, CategoryId& id) const;
+    const std::string&          categoryName(CategoryId id) const {return categoryNames_[id];}
+    const std::vector<CategoryId>&          sortedCategories() const {return sortedCategories_;}
+    const std::vector<std::vector<PkgId>>&  members() const {return members_;}
+    unsigned int                position(PkgId id) const {return position_[id];}
+    const DescriptionStore&     descriptions() const {return descriptions_;}
+    std::vector<uint32_t>       persistentStatuses() const;
+    void                        flushDescriptions() {descriptions_.flush();}
+    bool                        save(const std::string& path,
+                                     uint64_t fingerprint,
+                                     const std::vector<uint32_t>& statuses) const;
+    bool                        load(const std::string& path, uint64_t fingerprint);
 
-    std::string             origin;
-    std::string             comment;
-    std::string             description;
+   private:
+    using TextRef = TextArena::Ref;
 
-    bool operator<(const Port & other) const {return origin < other.origin;} 
+    struct KeysRef {
+      uint32_t offset {0};
+      uint32_t length {0};
+    };
+
+    // Local and remote versions
+    static const size_t numVersions = 2;
+
+    Bitmap                                       statuses_[numStatuses];
+    std::vector<Bitmap>                          categoryStatuses_[numStatuses];
+    std::vector<CategoryId>                      category_;
+    std::vector<TextRef>                         texts_[numTexts];
+    TextArena                                    arena_;
+    DescriptionStore                             descriptions_;
+    std::vector<KeysRef>                         versions_[numVersions];
+    std::vector<Version::Key>                    versionKeys_;
+    std::vector<PkgId>                           slots_;
+    std::deque<std::string>                      categoryNames_;
+    std::unordered_map<std::string, CategoryId>  categoryIndex_;
+    std::vector<CategoryId>                      sortedCategories_;
+    std::vector<std::vector<PkgId>>              members_;
+    std::vector<size_t>                          sortedMembers_;
+    std::vector<unsigned int>                    position_;
+    void*                                        mapping_ {nullptr};
+    size_t                                       mappingSize_ {0};
+
+    const char*  data(const TextRef& ref) const {return arena_.data(ref);}
+    void         unmap();
+    CategoryId   internCategory(const std::string& name);
+    size_t       findSlot(const char* origin, size_t len) const;
+    void         growIndex();
+    bool         lessByOrigin(PkgId lhs, PkgId rhs) const;
+    void         updatePositions(CategoryId category);
   };
 
+  // Ports to be displayed, listed by category identifier
+  using Selection = std::vector<std::vector<PkgId>>;
+
   Pkg();
+  ~Pkg();
   Pkg(const Pkg&) = delete;
   void operator=(const Pkg&) = delete;
 
-  bool      rootPrivileges_;
+  friend class Benchmark;
+
+  std::unique_ptr<Backend>  backend_;
+  bool                      useSnapshot_ {true};
+  bool                      lazyDescriptions_ {false};
+  std::mutex                fillMutex_;
+  Progress                  progress_;
 
-  // category -> set of Ports
-  using PkgRepo = std::map<std::string, std::set<Port>>;
+  // Batches of ports read by loader_ when loading in the background,
+  // waiting to be merged into the store, guarded by loadMutex_.
+  struct LoadedPorts {
+    Repo                    repo;
+    std::vector<Port>       ports;
+  };
+  std::mutex                                loadMutex_;
+  std::deque<LoadedPorts>                   loadedPorts_;
+  bool                                      loaderDone_ {false};
+  std::exception_ptr                        loadError_;
+  std::thread                               loader_;
+  std::chrono::steady_clock::time_point     loadStart_;
+  uint64_t                                  loadFingerprint_ {0};
+  bool                                      loadFingerprinted_ {false};
+
+  // Catalogues changed behind our back, as noticed by watcher_ polling
+  // their fingerprints, waiting to be applied, all guarded by
+  // watchMutex_. Only the ports that differ from the store are kept, the
+  // origins missing from ports being no longer listed. Catalogues read
+  // while a transaction was running, or the store loaded, are told apart
+  // by their generation, and dropped.
+  // The fingerprint of both catalogues is the one taken before they
+  // were read.
+  struct ChangedCatalogue {
+    Backend::Catalogue        catalogue;
+    std::vector<std::string>  origins;
+    std::vector<Port>         ports;
+    unsigned int              generation;
+    uint64_t                  fingerprint;
+    bool                      fingerprinted;
+  };
+  std::mutex                                watchMutex_;
+  std::condition_variable                   watchCond_;
+  std::deque<ChangedCatalogue>              changedCatalogues_;
+  unsigned int                              watchGeneration_ {0};
+  bool                                      transacting_ {false};
+  bool                                      loading_ {false};
+  bool                                      watcherStop_ {false};
+  std::thread                               watcher_;
+
+  // Snapshot to be written by saver_, which holds storeMutex_ shared
+  // meanwhile, all guarded by saveMutex_. Only the latest request is
+  // kept. The statuses are copied when the snapshot is requested, as they
+  // change without lockStore().
+  struct SnapshotRequest {
+    uint64_t                fingerprint {0};
+    std::vector<uint32_t>   statuses;
+  };
+  std::mutex                                saveMutex_;
+  std::condition_variable                   saveCond_;
+  SnapshotRequest                           saveRequest_;
+  bool                                      saveQueued_ {false};
+  bool                                      saverStop_ {false};
+  std::thread                               saver_;
+
+  // Dependencies of the installed ports, and of the remote ones, read by
+  // a background query once the packages are loaded, and again whenever
+  // they change.
+  struct DependencyEdges {
+    Backend::Edges          local;
+    Backend::Edges          remote;
+  };
+  std::future<DependencyEdges>              graphEdges_;
+  bool                                      graphEnabled_ {false};
+  bool                                      graphStale_ {false};
+  DependencyGraph                           localGraph_;
+  DependencyGraph                           remoteGraph_;
+
+  // Descriptions fetched on demand by descrLoader_ when
+  // lazyDescriptions_ is set, all guarded by descrMutex_.
+  mutable std::mutex                                  descrMutex_;
+  mutable std::condition_variable                     descrCond_;
+  mutable std::deque<std::pair<PkgId, std::string>>   descrRequests_;
+  mutable std::unordered_set<PkgId>                   descrQueued_;
+  std::unordered_map<PkgId, std::string>              descriptions_;
+  unsigned int                                        descrGeneration_ {0};
+  bool                                                descrLoaderStop_ {false};
+  std::thread                                         descrLoader_;
+
+  // Trigrams of the origins, comments and descriptions, used by search()
+  mutable std::mutex  indexMutex_;
+  TrigramIndex        searchIndex_;
+  bool                searchIndexBuilt_ {false};
+
+  // Searches started while typing, run by searcher_ so that the caller
+  // never waits for them. Only the latest query is kept, and the one
+  // running gives up as soon as searchGeneration_ moves on. The results
+  // of the last queries are cached, most recent first, so that a query
+  // typed again is answered at once, and a query extending a cached one
+  // only looks among its matches. All guarded by searchMutex_, while the
+  // searcher holds storeMutex_ shared, which is taken exclusively
+  // through lockStore() before the store changes.
+  struct SearchResults {
+    std::string             pattern;
+    std::vector<PkgId>      ids;
+  };
+  mutable std::mutex                        searchMutex_;
+  std::condition_variable                   searchCond_;
+  std::string                               searchQuery_;
+  bool                                      searchQueued_ {false};
+  bool                                      searchPending_ {false};
+  bool                                      searchReady_ {false};
+  SearchResults                             searchResults_;
+  std::list<SearchResults>                  searchCache_;
+  std::atomic<unsigned int>                 searchGeneration_ {0};
+  bool                                      searcherStop_ {false};
+  std::thread                               searcher_;
+  std::shared_mutex                         storeMutex_;
 
-  PkgRepo   refPkgs_; // to store local and remote packages set
-  PkgRepo   tmpPkgs_; // to store search/filter result set
-  PkgRepo*  pkgs_;    // pointer to the currently used package repository
+  Store             store_;   // to store local and remote packages set
+  Selection         tmpPkgs_; // to store search/filter result set
+  const Selection*  pkgs_;    // pointer to the currently used package selection
 
-  void                            checkPrivileges();
+  std::string                     getDescription(PkgId id) const;
+  void                            resetDescriptions();
+  void                            loadDescriptions();
+  std::vector<std::string>        getSearchableTexts(PkgId id) const;
+  void                            resetSearchIndex();
+  void                            buildSearchIndex();
+  void                            indexPort(PkgId id);
+  void                            addToSearchIndex(PkgId id);
+  bool                            findMatches(const std::string& pattern,
+                                              const std::vector<PkgId>* within,
+                                              const unsigned int* generation,
+                                              std::vector<PkgId>& ids);
+  const SearchResults*            findCachedSearch(const std::string& pattern, bool& exact);
+  void                            cacheSearch(const std::string& pattern,
+                                              const std::vector<PkgId>& ids);
+  void                            runSearches();
+  std::unique_lock<std::shared_mutex>  lockStore();
+  std::string                     getSnapshotPath() const;
+  bool                            getCatalogueFingerprint(uint64_t& fingerprint) const;
+  bool                            loadSnapshot();
+  void                            loadCatalogues();
+  void                            reloadStore(Repo repo);
+  void                            queuePackagesList(Repo repo);
   void                            buildPackagesList(Repo repo);
-  void                            execPkg(const std::string& args) const;
-  std::vector<Port>               runPkg(const std::string& args) const;
-  std::vector<Port>               runPkgSearch(const std::string& args) const;
+  std::vector<std::string>        getDependencyClosure(DependencyQuery query,
+                                                       const std::vector<std::string>& origins) const;
+  void                            refresh(const std::vector<std::string>& origins);
+  void                            patchPorts(Repo repo,
+                                             const std::vector<std::string>& origins,
+                                             std::vector<Port>& pkgs);
+  void                            watchCatalogues();
+  std::vector<std::string>        getChangedOrigins(Repo repo, const Backend::Versions& versions);
+  void                            startLoadingGraph();
+  void                            buildGraph(DependencyGraph& graph, const Backend::Edges& edges);
+  std::vector<std::string>        getOrigins(const std::vector<DependencyGraph::Node>& ids) const;
+  void                            setTransacting(bool transacting);
+  void                            setLoading(bool loading);
+  void                            saveSnapshot(uint64_t fingerprint);
+  void                            saveSnapshots();
+  void                            updateUpgradeStatus(PkgId id);
   void                            fillPkgRepo(Repo repo, std::vector<Port>& pkgs);
-  void                            fillTmpRepo(std::vector<Port>& pkgs);
-  const Pkg::Port&                getPort(const std::string& origin) const;
-  std::tuple<bool, std::string>   extractToken(FILE* fp, const char delim) const;
-  std::string                     getCategoryFromOrigin(const std::string& origin) const;
+  void                            fillTmpRepo(const std::vector<PkgId>& ids);
+  void                            clearTmpRepo();
+  void                            checkId(PkgId id) const;
+  const std::vector<PkgId>&       getSelection(const std::string& category) const;
   void                            resetPending();
-  void                            switchToReferenceRepository() {pkgs_ = &refPkgs_;}
+  void                            switchToReferenceRepository() {pkgs_ = &store_.members();}
   void                            switchToTemporaryRepository() {pkgs_ = &tmpPkgs_;}
 };
 
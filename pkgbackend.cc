@@ -0,0 +1,629 @@
+/*-
+ * Copyright (c) 2016 Frederic Culot <culot@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <unistd.h>
+#include <dirent.h>
+#include <syslog.h>
+#ifdef WITH_SQLITE
+#include <sqlite3.h>
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <future>
+#include <iterator>
+#include <memory>
+
+#include "hash.h"
+#include "parser.h"
+#include "pkgbackend.h"
+
+namespace portal {
+
+static const char delimiter = '\2';
+
+// Pipes opened by popen(3), closed whatever the parsing or the consumers
+// of their output throw
+using PipePtr = std::unique_ptr<FILE, int (*)(FILE*)>;
+
+// Sizes are printed by pkg(8) with humanize_number(3), e.g. "12 MiB"
+static uint64_t parseSize(const std::string& str) {
+  static const std::string prefixes("KMGTP");
+
+  double value;
+  char unit[8] = "";
+  if (sscanf(str.c_str(), "%lf %7s", &value, unit) < 1) {
+    return 0;
+  }
+  size_t exponent = prefixes.find(toupper(unit[0]));
+  if (unit[0] != '\0' && exponent != std::string::npos) {
+    for (size_t i = 0; i <= exponent; ++i) {
+      value *= 1024;
+    }
+  }
+
+  return static_cast<uint64_t>(value);
+}
+
+static std::string joinOrigins(const std::vector<std::string>& origins) {
+  std::string joined;
+  for (const auto& origin : origins) {
+    joined.append(" ");
+    joined.append(origin);
+  }
+
+  return joined;
+}
+
+// Format of the records parsed by runPkg(). The description is left
+// empty if not requested, which allows to fetch it separately.
+static std::string queryFormat(bool withDescription) {
+  std::stringstream format;
+  format << "'%o"
+         << delimiter
+         << "%v"
+         << delimiter
+         << "%c"
+         << delimiter
+         << (withDescription ? "%e" : "")
+         << delimiter
+         << "'";
+
+  return format.str();
+}
+
+static std::string getDatabaseDir() {
+  const char* env = getenv("PKG_DBDIR");
+  return env != nullptr ? env : "/var/db/pkg";
+}
+
+#ifdef WITH_SQLITE
+// Databases pkg(8) keeps for the given repository: local.sqlite for the
+// installed packages, and one catalogue per remote repository.
+static std::vector<std::string> getDatabasePaths(Backend::Catalogue catalogue) {
+  std::string dbdir = getDatabaseDir();
+  std::vector<std::string> paths;
+
+  std::vector<std::string> names;
+  if (catalogue == Backend::Catalogue::local) {
+    names.push_back("local.sqlite");
+  } else {
+    DIR* dir = opendir(dbdir.c_str());
+    if (dir != nullptr) {
+      struct dirent* entry;
+      while ((entry = readdir(dir)) != nullptr) {
+        std::string name(entry->d_name);
+        if (name.compare(0, 5, "repo-") == 0 && name.length() > 12
+            && name.compare(name.length() - 7, 7, ".sqlite") == 0) {
+          names.push_back(name);
+        }
+      }
+      closedir(dir);
+    }
+    std::sort(names.begin(), names.end());
+  }
+
+  for (const auto& name : names) {
+    std::string path = dbdir + "/" + name;
+    struct stat sb;
+    if (stat(path.c_str(), &sb) == 0 && S_ISREG(sb.st_mode)) {
+      paths.push_back(path);
+    }
+  }
+
+  return paths;
+}
+
+static std::string getColumnText(sqlite3_stmt* stmt, int column) {
+  const unsigned char* text = sqlite3_column_text(stmt, column);
+  if (text == nullptr) {
+    return std::string();
+  }
+
+  return std::string(reinterpret_cast<const char*>(text), sqlite3_column_bytes(stmt, column));
+}
+#endif
+
+PkgBackend::PkgBackend(unsigned int remoteShards)
+  : remoteShards_(remoteShards) {
+}
+
+void PkgBackend::getPorts(Catalogue catalogue, bool withDescription, const Consumer& consumer) {
+  std::vector<Port> pkgs;
+  if (readDatabases(catalogue, Origins(), withDescription, pkgs)) {
+    consumer(pkgs);
+    return;
+  }
+
+  std::string format = queryFormat(withDescription);
+  if (catalogue == Catalogue::local) {
+    runPkg("query -a " + format, consumer);
+  } else if (remoteShards_ > 1) {
+    getShardedPorts(format, consumer);
+  } else {
+    runPkg("rquery -a " + format, consumer);
+  }
+}
+
+std::vector<Backend::Port> PkgBackend::getPorts(Catalogue catalogue,
+                                                const Origins& origins,
+                                                bool withDescription) {
+  std::vector<Port> pkgs;
+  if (!readDatabases(catalogue, origins, withDescription, pkgs)) {
+    std::string command = catalogue == Catalogue::local ? "query " : "rquery ";
+    pkgs = runPkg(command + queryFormat(withDescription)
+                  + joinOrigins(origins) + " 2>/dev/null");
+  }
+
+  return pkgs;
+}
+
+// Comments are read along with the versions from the databases, which
+// costs little next to opening them.
+Backend::Versions PkgBackend::getVersions(Catalogue catalogue) {
+  Versions versions;
+  std::vector<Port> pkgs;
+  if (readDatabases(catalogue, Origins(), false, pkgs)) {
+    versions.reserve(pkgs.size());
+    for (auto& port : pkgs) {
+      versions.emplace_back(std::move(port.origin), std::move(port.version));
+    }
+    return versions;
+  }
+
+  std::string command = catalogue == Catalogue::local ? "query" : "rquery";
+  for (const auto& line : runPkgLines(command + " -a '%o %v'")) {
+    size_t space = line.find(' ');
+    if (space != std::string::npos) {
+      versions.emplace_back(line.substr(0, space), line.substr(space + 1));
+    }
+  }
+
+  return versions;
+}
+
+Backend::Origins PkgBackend::getDependencies(const Origins& origins) {
+  return runPkgLines("rquery '%do'" + joinOrigins(origins));
+}
+
+Backend::Origins PkgBackend::getDependents(const Origins& origins) {
+  return runPkgLines("query '%ro'" + joinOrigins(origins));
+}
+
+// Multiline patterns make pkg(8) print one line per dependency
+Backend::Edges PkgBackend::getDependencyEdges(Catalogue catalogue) {
+  std::string command = catalogue == Catalogue::local ? "query" : "rquery";
+  Edges edges;
+  for (const auto& line : runPkgLines(command + " -a '%o %do'")) {
+    size_t space = line.find(' ');
+    if (space != std::string::npos) {
+      edges.emplace_back(line.substr(0, space), line.substr(space + 1));
+    }
+  }
+
+  return edges;
+}
+
+void PkgBackend::install(const Origins& origins, Progress& progress) {
+  execPkg("install -y" + joinOrigins(origins), progress);
+}
+
+void PkgBackend::remove(const Origins& origins, Progress& progress) {
+  execPkg("delete -y" + joinOrigins(origins), progress);
+}
+
+bool PkgBackend::canModify() const {
+  return getuid() == 0;
+}
+
+// Combine the name, size, modification time and SQLite header of the
+// local package database, or of every repository catalogue. The header
+// holds a change counter that is bumped by every write transaction, so
+// reading its first bytes is enough to detect modifications without
+// checksumming whole databases. Only the databases themselves are
+// looked at, not their journals. There is no fingerprint if the
+// database directory cannot be read.
+bool PkgBackend::getFingerprint(Catalogue catalogue, uint64_t& fingerprint) const {
+  static const std::string suffix(".sqlite");
+  std::string dbdir = getDatabaseDir();
+  std::string prefix(catalogue == Catalogue::local ? "local" : "repo-");
+
+  DIR* dir = opendir(dbdir.c_str());
+  if (dir == nullptr) {
+    return false;
+  }
+  std::vector<std::string> files;
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    std::string name(entry->d_name);
+    if (name.length() >= prefix.length() + suffix.length()
+        && name.compare(0, prefix.length(), prefix) == 0
+        && name.compare(name.length() - suffix.length(), suffix.length(), suffix) == 0) {
+      files.push_back(name);
+    }
+  }
+  closedir(dir);
+  std::sort(files.begin(), files.end());
+
+  fingerprint = fnv1a(dbdir.data(), dbdir.length());
+  for (const auto& name : files) {
+    std::string path = dbdir + "/" + name;
+    struct stat sb;
+    if (stat(path.c_str(), &sb) != 0 || !S_ISREG(sb.st_mode)) {
+      continue;
+    }
+    int64_t attrs[] = {static_cast<int64_t>(sb.st_size),
+                       static_cast<int64_t>(sb.st_mtim.tv_sec),
+                       static_cast<int64_t>(sb.st_mtim.tv_nsec)};
+    fingerprint = fnv1a(name.data(), name.length(), fingerprint);
+    fingerprint = fnv1a(attrs, sizeof(attrs), fingerprint);
+
+    char header[100];
+    FILE* fp = fopen(path.c_str(), "r");
+    if (fp != nullptr) {
+      size_t len = fread(header, 1, sizeof(header), fp);
+      fingerprint = fnv1a(header, len, fingerprint);
+      fclose(fp);
+    }
+  }
+
+  return true;
+}
+
+// Split the remote query into several rquery invocations running in
+// parallel, one per glob returned by getShardGlobs().
+void PkgBackend::getShardedPorts(const std::string& format, const Consumer& consumer) {
+  std::vector<std::future<void>> loaders;
+  for (const auto& glob : getShardGlobs(remoteShards_)) {
+    std::string args = "rquery -e '%o ~ " + glob + "' " + format;
+    loaders.push_back(std::async(std::launch::async, [this, args, &consumer]() {
+          runPkg(args, consumer);
+        }));
+  }
+
+  for (auto& loader : loaders) {
+    loader.get();
+  }
+}
+
+// Globs of the origins fetched by each shard, for the ~ operator of
+// pkg(8) which relies on the GLOB of SQLite: each shard is restricted to
+// the categories starting with a given range of letters, and the last
+// one catches all the origins that were not matched by the previous
+// ones. SQLite negates a class with ^, not with ! as sh(1) does.
+std::vector<std::string> PkgBackend::getShardGlobs(unsigned int shards) {
+  static const std::string letters("abcdefghijklmnopqrstuvwxyz");
+  shards = std::max(1u, std::min<unsigned int>(shards, letters.length()));
+
+  std::vector<std::string> globs;
+  size_t first = 0;
+  for (unsigned int i = 0; i < shards - 1; ++i) {
+    size_t last = letters.length() * (i + 1) / shards - 1;
+    globs.push_back(std::string("[") + letters[first] + "-" + letters[last] + "]*");
+    first = last + 1;
+  }
+  globs.push_back(first == 0 ? "*" : std::string("[^a-") + letters[first - 1] + "]*");
+
+  return globs;
+}
+
+// Read the packages straight from the SQLite databases maintained by
+// pkg(8), restricted to the given origins if any. Return false if portal
+// was built without SQLite support, if there is no database to read or
+// if one of them could not be read, in which case pkg(8) should be
+// queried instead.
+bool PkgBackend::readDatabases(Catalogue catalogue,
+                               const Origins& origins,
+                               bool withDescription,
+                               std::vector<Port>& pkgs) const {
+#ifdef WITH_SQLITE
+  std::vector<std::string> paths = getDatabasePaths(catalogue);
+  if (paths.empty()) {
+    return false;
+  }
+
+  size_t numPkgs = pkgs.size();
+  try {
+    for (const auto& path : paths) {
+      readDatabase(path, origins, withDescription, pkgs);
+    }
+  }
+  catch (std::exception& e) {
+    syslog(LOG_WARNING, "%s", e.what());
+    pkgs.resize(numPkgs);
+    return false;
+  }
+
+  return true;
+#else
+  return false;
+#endif
+}
+
+#ifdef WITH_SQLITE
+void PkgBackend::readDatabase(const std::string& path,
+                              const Origins& origins,
+                              bool withDescription,
+                              std::vector<Port>& pkgs) const {
+  sqlite3* db = nullptr;
+  if (sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+    sqlite3_close(db);
+    throw std::runtime_error("PkgBackend::readDatabase(): could not open [" + path + "]");
+  }
+  std::unique_ptr<sqlite3, int (*)(sqlite3*)> dbGuard(db, sqlite3_close);
+  // pkg(8) may be writing to the database
+  sqlite3_busy_timeout(db, 5000);
+
+  std::string sql("SELECT origin, version, comment, ");
+  sql.append(withDescription ? "desc" : "''");
+  sql.append(" FROM packages");
+  if (!origins.empty()) {
+    sql.append(" WHERE origin = ?1");
+  }
+  sqlite3_stmt* stmt = nullptr;
+  if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+    throw std::runtime_error("PkgBackend::readDatabase(): could not query [" + path + "]: "
+                             + sqlite3_errmsg(db));
+  }
+  std::unique_ptr<sqlite3_stmt, int (*)(sqlite3_stmt*)> stmtGuard(stmt, sqlite3_finalize);
+
+  auto readRows = [&]() {
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+      Port port;
+      port.origin = getColumnText(stmt, 0);
+      port.version = getColumnText(stmt, 1);
+      port.comment = getColumnText(stmt, 2);
+      port.description = getColumnText(stmt, 3);
+      pkgs.push_back(std::move(port));
+    }
+    if (rc != SQLITE_DONE) {
+      throw std::runtime_error("PkgBackend::readDatabase(): could not read [" + path + "]: "
+                               + sqlite3_errmsg(db));
+    }
+  };
+
+  if (origins.empty()) {
+    readRows();
+  } else {
+    for (const auto& origin : origins) {
+      sqlite3_bind_text(stmt, 1, origin.data(), origin.length(), SQLITE_STATIC);
+      readRows();
+      sqlite3_reset(stmt);
+    }
+  }
+}
+#endif
+
+// Run a transaction and follow its output. pkg(8) prints one line per
+// package and step, such as "[2/5] Installing foo-1.0...", and draws the
+// progress of fetches with one dot every tenth of the file, hence the
+// current line is parsed again whenever more output is read. Only the
+// total size to download is known, fetched bytes are thus estimated
+// from the number of fetches and of their dots.
+void PkgBackend::execPkg(const std::string& args, Progress& progress) const {
+  static const struct {
+    const char*     verb;
+    Progress::Step  step;
+  } steps[] = {
+    {"Fetching ", Progress::Step::fetching},
+    {"Installing ", Progress::Step::installing},
+    {"Upgrading ", Progress::Step::installing},
+    {"Downgrading ", Progress::Step::installing},
+    {"Reinstalling ", Progress::Step::installing},
+    {"Extracting ", Progress::Step::installing},
+    {"Deinstalling ", Progress::Step::removing},
+    {"Deleting files for ", Progress::Step::removing}
+  };
+  static const std::string errorPrefix("pkg: ");
+  static const std::string downloadSuffix(" to be downloaded.");
+
+  std::string cmd("pkg " + args + " 2>&1");
+
+  FILE * pipe = popen(cmd.c_str(), "r");
+  if (!pipe) {
+    throw std::runtime_error("PkgBackend::execPkg(): could not execute [" + cmd + "]");
+  }
+  PipePtr pipeGuard(pipe, pclose);
+
+  uint64_t bytesTotal = 0;
+  std::string lastError;
+  auto parseLine = [&](const std::string& line, bool complete) {
+    size_t index, count;
+    int offset = 0;
+    if (sscanf(line.c_str(), "[%zu/%zu] %n", &index, &count, &offset) == 2 && offset > 0) {
+      for (const auto& step : steps) {
+        size_t verbLen = strlen(step.verb);
+        if (line.compare(offset, verbLen, step.verb) != 0) {
+          continue;
+        }
+        size_t nameBegin = offset + verbLen;
+        size_t nameEnd = line.find_first_of(": ", nameBegin);
+        std::string name = line.substr(nameBegin, nameEnd - nameBegin);
+        while (!name.empty() && name.back() == '.') {
+          name.pop_back();
+        }
+        if (step.step == Progress::Step::fetching && count > 0) {
+          if (name.size() > 4 && name.compare(name.size() - 4, 4, ".pkg") == 0) {
+            name.resize(name.size() - 4);
+          }
+          size_t dots = 0;
+          if (nameEnd != std::string::npos) {
+            dots = std::count(line.begin() + nameEnd, line.end(), '.');
+          }
+          if (line.find("done", nameBegin) != std::string::npos) {
+            dots = 10;
+          }
+          double fetched = (index - 1 + std::min<size_t>(dots, 10) / 10.0) / count;
+          progress.setBytesFetched(static_cast<uint64_t>(bytesTotal * fetched));
+        }
+        progress.setPackage(step.step, name, index, count);
+        break;
+      }
+    } else if (!complete) {
+      return;
+    } else if (line.compare(0, errorPrefix.length(), errorPrefix) == 0) {
+      lastError = line.substr(errorPrefix.length());
+      progress.addError(lastError);
+      syslog(LOG_ERR, "PkgBackend::execPkg(): %s", lastError.c_str());
+    } else if (line.length() > downloadSuffix.length()
+               && line.compare(line.length() - downloadSuffix.length(),
+                               downloadSuffix.length(), downloadSuffix) == 0) {
+      bytesTotal = parseSize(line);
+      progress.addBytesTotal(bytesTotal);
+    }
+  };
+
+  char buf[4096];
+  std::string line;
+  for (;;) {
+    ssize_t len = read(fileno(pipe), buf, sizeof(buf));
+    if (len < 0 && errno == EINTR) {
+      continue;
+    }
+    if (len <= 0) {
+      break;
+    }
+    for (ssize_t i = 0; i < len; ++i) {
+      if (buf[i] == '\n' || buf[i] == '\r') {
+        parseLine(line, true);
+        line.clear();
+      } else {
+        line.push_back(buf[i]);
+      }
+    }
+    if (!line.empty()) {
+      parseLine(line, false);
+    }
+  }
+  if (!line.empty()) {
+    parseLine(line, true);
+  }
+
+  int status = pclose(pipeGuard.release());
+  if (status != 0) {
+    throw std::runtime_error("PkgBackend::execPkg(): [" + cmd + "] failed"
+                             + (lastError.empty() ? std::string() : ": " + lastError));
+  }
+}
+
+std::vector<Backend::Port> PkgBackend::runPkg(const std::string & args) const {
+  std::vector<Port> result;
+  runPkg(args, [&result](std::vector<Port>& ports) {
+      result.insert(result.end(),
+                    std::make_move_iterator(ports.begin()),
+                    std::make_move_iterator(ports.end()));
+    });
+
+  return result;
+}
+
+// Parse the records output by pkg(8), and hand them to the consumer by
+// batches while the query is still running.
+void PkgBackend::runPkg(const std::string & args, const Consumer& consumer) const {
+  std::string cmd("pkg " + args);
+
+  FILE * pipe = popen(cmd.c_str(), "r");
+  if (!pipe) {
+    throw std::runtime_error("PkgBackend::runPkg(): could not execute [" + cmd + "]");
+  }
+  PipePtr pipeGuard(pipe, pclose);
+
+  std::vector<Port> batch;
+  size_t numPorts = 0;
+  Parser parser(fileno(pipe));
+  Parser::Field field;
+
+  for (;;) {
+    struct Port port;
+
+    if (!parser.nextField(delimiter, field)) {
+      break;
+    }
+    port.origin.assign(field.data, field.len);
+    if (!parser.nextField(delimiter, field)) {
+      break;
+    }
+    port.version.assign(field.data, field.len);
+    if (!parser.nextField(delimiter, field)) {
+      throw std::runtime_error("PkgBackend::runPkg(): EOF reached when reading comment for ["
+                               + port.origin + "]");
+    }
+    port.comment.assign(field.data, field.len);
+    if (!parser.nextField(delimiter, field)) {
+      throw std::runtime_error("PkgBackend::runPkg(): EOF reached when reading descr for ["
+                               + port.origin + "]");
+    }
+    port.description.assign(field.data, field.len);
+    // discard end of line
+    parser.skipPast('\n');
+
+    batch.push_back(std::move(port));
+    if (batch.size() == batchSize) {
+      numPorts += batch.size();
+      consumer(batch);
+      batch.clear();
+    }
+  }
+
+  pipeGuard.reset();
+  numPorts += batch.size();
+  if (!batch.empty()) {
+    consumer(batch);
+  }
+
+  syslog(LOG_INFO, "PkgBackend::runPkg(): parsed %zu packages, %zu bytes in %.3fs (%.1f MB/s)",
+         numPorts, parser.bytesRead(), parser.elapsedSeconds(), parser.throughput());
+}
+
+std::vector<std::string> PkgBackend::runPkgLines(const std::string & args) const {
+  std::string cmd("pkg " + args + " 2>/dev/null");
+
+  FILE * pipe = popen(cmd.c_str(), "r");
+  if (!pipe) {
+    throw std::runtime_error("PkgBackend::runPkgLines(): could not execute [" + cmd + "]");
+  }
+  PipePtr pipeGuard(pipe, pclose);
+
+  std::vector<std::string> result;
+  Parser parser(fileno(pipe));
+  Parser::Field field;
+
+  while (parser.nextField('\n', field)) {
+    result.push_back(field.str());
+  }
+
+  return result;
+}
+
+}
@@ -0,0 +1,77 @@
+/*-
+ * Copyright (c) 2016 Frederic Culot <culot@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "backend.h"
+
+namespace portal {
+
+// Backend running pkg(8), or reading its SQLite databases directly when
+// built with WITH_SQLITE. The remote catalogue can be fetched by several
+// rquery invocations running in parallel.
+class PkgBackend : public Backend {
+ public:
+  explicit PkgBackend(unsigned int remoteShards = 1);
+
+  void               getPorts(Catalogue catalogue,
+                              bool withDescription,
+                              const Consumer& consumer) override;
+  std::vector<Port>  getPorts(Catalogue catalogue,
+                              const Origins& origins,
+                              bool withDescription) override;
+  Versions           getVersions(Catalogue catalogue) override;
+  Origins            getDependencies(const Origins& origins) override;
+  Origins            getDependents(const Origins& origins) override;
+  Edges              getDependencyEdges(Catalogue catalogue) override;
+  void               install(const Origins& origins, Progress& progress) override;
+  void               remove(const Origins& origins, Progress& progress) override;
+  bool               canModify() const override;
+  bool               getFingerprint(Catalogue catalogue,
+                                    uint64_t& fingerprint) const override;
+
+  static std::vector<std::string>  getShardGlobs(unsigned int shards);
+
+ private:
+  unsigned int  remoteShards_;
+
+  void                      getShardedPorts(const std::string& format,
+                                            const Consumer& consumer);
+  bool                      readDatabases(Catalogue catalogue,
+                                          const Origins& origins,
+                                          bool withDescription,
+                                          std::vector<Port>& pkgs) const;
+  void                      readDatabase(const std::string& path,
+                                         const Origins& origins,
+                                         bool withDescription,
+                                         std::vector<Port>& pkgs) const;
+  void                      execPkg(const std::string& args, Progress& progress) const;
+  std::vector<Port>         runPkg(const std::string& args) const;
+  void                      runPkg(const std::string& args, const Consumer& consumer) const;
+  std::vector<std::string>  runPkgLines(const std::string& args) const;
+};
+
+}
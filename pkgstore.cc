@@ -0,0 +1,618 @@
+/*-
+ * Copyright (c) 2016 Frederic Culot <culot@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include "hash.h"
+#include "pkg.h"
+
+namespace portal {
+
+static const Pkg::PkgId emptySlot = static_cast<Pkg::PkgId>(-1);
+
+template<typename T>
+static bool allBelow(const std::vector<T>& values, uint64_t bound) {
+  return std::all_of(values.begin(), values.end(), [bound](T value) {return value < bound;});
+}
+
+// Layout of a snapshot file: the header is followed by the columns,
+// the origin index, the categories, the decomposed versions, the text
+// arena and finally the descriptions. The arena and the compressed
+// descriptions are served directly from the mapped file once loaded.
+static const char     snapshotMagic[8] = {'P', 'O', 'R', 'T', 'A', 'L', 'S', 'N'};
+static const uint64_t snapshotVersion = 5;
+
+struct SnapshotHeader {
+  char     magic[8];
+  uint64_t version;
+  uint64_t fingerprint;
+  uint64_t numPkgs;
+  uint64_t numCategories;
+  uint64_t numSlots;
+  uint64_t numVersionKeys;
+  uint64_t namesSize;
+  uint64_t arenaSize;
+  uint64_t numDescriptions;
+  uint64_t numDescriptionBlocks;
+  uint64_t descriptionsSize;
+};
+
+Pkg::Store::~Store() {
+  unmap();
+}
+
+void Pkg::Store::clear() {
+  unmap();
+  for (auto& bitmap : statuses_) {
+    bitmap.clear();
+  }
+  for (auto& bitmaps : categoryStatuses_) {
+    bitmaps.clear();
+  }
+  category_.clear();
+  for (auto& column : texts_) {
+    column.clear();
+  }
+  arena_.clear();
+  descriptions_.clear();
+  for (auto& column : versions_) {
+    column.clear();
+  }
+  versionKeys_.clear();
+  slots_.clear();
+  categoryNames_.clear();
+  categoryIndex_.clear();
+  sortedCategories_.clear();
+  members_.clear();
+  sortedMembers_.clear();
+  position_.clear();
+}
+
+// Return the identifier of the port with the given origin, creating an
+// empty record for it if it is not known yet.
+Pkg::PkgId Pkg::Store::insert(const std::string& origin, bool& inserted) {
+  if ((size() + 1) * 2 > slots_.size()) {
+    growIndex();
+  }
+
+  size_t slot = findSlot(origin.data(), origin.length());
+  if (slots_[slot] != emptySlot) {
+    inserted = false;
+    return slots_[slot];
+  }
+
+  PkgId id = size();
+  CategoryId category = internCategory(std::string(origin, 0, origin.find('/')));
+  for (auto& bitmap : statuses_) {
+    bitmap.resize(id + 1);
+  }
+  category_.push_back(category);
+  for (auto& column : texts_) {
+    column.push_back(TextRef());
+  }
+  for (auto& column : versions_) {
+    column.push_back(KeysRef());
+  }
+  texts_[Text::origin][id] = arena_.append(origin.data(), origin.length());
+  members_[category].push_back(id);
+  slots_[slot] = id;
+
+  inserted = true;
+  return id;
+}
+
+bool Pkg::Store::find(const std::string& origin, PkgId& id) const {
+  if (slots_.empty()) {
+    return false;
+  }
+
+  size_t slot = findSlot(origin.data(), origin.length());
+  id = slots_[slot];
+
+  return id != emptySlot;
+}
+
+// Order categories by name and ports within categories by origin, which
+// is the order in which they are listed.
+void Pkg::Store::sort() {
+  sortedCategories_.resize(categoryNames_.size());
+  for (CategoryId id = 0; id < sortedCategories_.size(); ++id) {
+    sortedCategories_[id] = id;
+  }
+  std::sort(sortedCategories_.begin(), sortedCategories_.end(),
+            [this](CategoryId lhs, CategoryId rhs) {
+              return categoryNames_[lhs] < categoryNames_[rhs];
+            });
+
+  // Ports are appended to their category when inserted, so only those
+  // inserted since the previous call need to be sorted, then merged with
+  // the others. Untouched categories keep their positions.
+  auto less = [this](PkgId lhs, PkgId rhs) {return lessByOrigin(lhs, rhs);};
+  sortedMembers_.resize(members_.size(), 0);
+  position_.resize(size());
+  for (CategoryId category = 0; category < members_.size(); ++category) {
+    std::vector<PkgId>& ids = members_[category];
+    auto sortedEnd = ids.begin() + sortedMembers_[category];
+    if (sortedEnd == ids.end()) {
+      continue;
+    }
+    std::sort(sortedEnd, ids.end(), less);
+    std::inplace_merge(ids.begin(), sortedEnd, ids.end(), less);
+    sortedMembers_[category] = ids.size();
+    updatePositions(category);
+  }
+}
+
+std::string Pkg::Store::text(PkgId id, Text column) const {
+  const TextRef& ref = texts_[column][id];
+  if (column == Text::description) {
+    return ref.length != 0 ? descriptions_.get(ref.offset) : std::string();
+  }
+  return std::string(data(ref), ref.length);
+}
+
+// Descriptions are kept compressed, and cannot be viewed in place.
+std::string_view Pkg::Store::textView(PkgId id, Text column) const {
+  if (column == Text::description) {
+    throw std::runtime_error("Pkg::Store::textView(): descriptions cannot be viewed");
+  }
+  const TextRef& ref = texts_[column][id];
+
+  return std::string_view(data(ref), ref.length);
+}
+
+std::string_view Pkg::Store::name(PkgId id) const {
+  const TextRef& ref = texts_[Text::origin][id];
+  const char* origin = data(ref);
+  const char* slash = static_cast<const char*>(memchr(origin, '/', ref.length));
+  size_t offset = slash != nullptr ? slash - origin + 1 : 0;
+
+  return std::string_view(origin + offset, ref.length - offset);
+}
+
+bool Pkg::Store::sameText(PkgId id, Text column, Text other) const {
+  const TextRef& lhs = texts_[column][id];
+  const TextRef& rhs = texts_[other][id];
+
+  return lhs.length == rhs.length && memcmp(data(lhs), data(rhs), lhs.length) == 0;
+}
+
+// Texts are never overwritten in place: the new value is appended to the
+// arena and the column points to it. Versions are also decomposed into
+// keys, appended the same way.
+void Pkg::Store::setText(PkgId id, Text column, const std::string& text) {
+  if (column == Text::description) {
+    TextRef& ref = texts_[column][id];
+    ref.offset = text.empty() ? 0 : descriptions_.add(text.data(), text.length());
+    ref.length = text.length();
+    return;
+  }
+  texts_[column][id] = arena_.append(text.data(), text.length());
+
+  if (column == Text::localVersion || column == Text::remoteVersion) {
+    KeysRef& ref = versions_[column - Text::localVersion][id];
+    ref.offset = versionKeys_.size();
+    Version::decompose(text.data(), text.length(), versionKeys_);
+    ref.length = versionKeys_.size() - ref.offset;
+  }
+}
+
+// Compare the local version of a port with the remote one, which must
+// both be set.
+int Pkg::Store::compareVersions(PkgId id) const {
+  const KeysRef& local = versions_[0][id];
+  const KeysRef& remote = versions_[1][id];
+
+  return Version::compare(versionKeys_.data() + local.offset, local.length,
+                          versionKeys_.data() + remote.offset, remote.length);
+}
+
+bool Pkg::Store::findCategory(const std::string& name, CategoryId& id) const {
+  auto it = categoryIndex_.find(name);
+  if (it == categoryIndex_.end()) {
+    return false;
+  }
+  id = it->second;
+
+  return true;
+}
+
+Pkg::CategoryId Pkg::Store::internCategory(const std::string& name) {
+  auto it = categoryIndex_.find(name);
+  if (it != categoryIndex_.end()) {
+    return it->second;
+  }
+
+  CategoryId id = categoryNames_.size();
+  categoryNames_.push_back(name);
+  categoryIndex_.emplace(name, id);
+  members_.emplace_back();
+
+  return id;
+}
+
+// Open addressing with linear probing: return the slot holding the
+// given origin, or the empty slot where it should be inserted.
+size_t Pkg::Store::findSlot(const char* origin, size_t len) const {
+  size_t mask = slots_.size() - 1;
+  size_t slot = fnv1a(origin, len) & mask;
+
+  for (;;) {
+    PkgId id = slots_[slot];
+    if (id == emptySlot) {
+      return slot;
+    }
+    const TextRef& ref = texts_[Text::origin][id];
+    if (ref.length == len && memcmp(data(ref), origin, len) == 0) {
+      return slot;
+    }
+    slot = (slot + 1) & mask;
+  }
+}
+
+void Pkg::Store::growIndex() {
+  size_t capacity = slots_.empty() ? 1024 : slots_.size() * 2;
+  slots_.assign(capacity, emptySlot);
+
+  for (PkgId id = 0; id < size(); ++id) {
+    const TextRef& ref = texts_[Text::origin][id];
+    slots_[findSlot(data(ref), ref.length)] = id;
+  }
+}
+
+bool Pkg::Store::lessByOrigin(PkgId lhs, PkgId rhs) const {
+  const TextRef& lref = texts_[Text::origin][lhs];
+  const TextRef& rref = texts_[Text::origin][rhs];
+  int cmp = memcmp(data(lref), data(rref), std::min(lref.length, rref.length));
+
+  return cmp < 0 || (cmp == 0 && lref.length < rref.length);
+}
+
+// Statuses to be saved, the actions marked by the user only lasting for
+// the session
+std::vector<uint32_t> Pkg::Store::persistentStatuses() const {
+  Status persistent;
+  persistent.set().reset(pendingInstall).reset(pendingRemoval);
+
+  std::vector<uint32_t> statuses;
+  statuses.reserve(size());
+  for (PkgId id = 0; id < size(); ++id) {
+    statuses.push_back((status(id) & persistent).to_ulong());
+  }
+
+  return statuses;
+}
+
+// Columns are written in the order described by SnapshotHeader, the
+// statuses being the ones returned by persistentStatuses() and the
+// descriptions flushed beforehand. The file is first written under a
+// temporary name and then renamed, so that a concurrent reader never
+// sees a partial snapshot. The temporary file is created exclusively, as
+// the home directory it lives in may belong to another user than the one
+// running portal.
+bool Pkg::Store::save(const std::string& path,
+                      uint64_t fingerprint,
+                      const std::vector<uint32_t>& statuses) const {
+  std::string names;
+  for (const auto& name : categoryNames_) {
+    names.append(name);
+    names.push_back('\0');
+  }
+
+  std::vector<uint32_t> memberOffsets, memberIds;
+  for (const auto& ids : members_) {
+    memberOffsets.push_back(memberIds.size());
+    memberIds.insert(memberIds.end(), ids.begin(), ids.end());
+  }
+  memberOffsets.push_back(memberIds.size());
+
+  SnapshotHeader header;
+  memcpy(header.magic, snapshotMagic, sizeof(header.magic));
+  header.version = snapshotVersion;
+  header.fingerprint = fingerprint;
+  header.numPkgs = size();
+  header.numCategories = categoryNames_.size();
+  header.numSlots = slots_.size();
+  header.numVersionKeys = versionKeys_.size();
+  header.namesSize = names.size();
+  header.arenaSize = arena_.size();
+  header.numDescriptions = descriptions_.numEntries();
+  header.numDescriptionBlocks = descriptions_.numBlocks();
+  header.descriptionsSize = descriptions_.compressedSize();
+
+  std::string tmpPath = path + ".XXXXXX";
+  int fd = mkstemp(&tmpPath[0]);
+  if (fd < 0) {
+    return false;
+  }
+  FILE* fp = fdopen(fd, "w");
+  if (fp == nullptr) {
+    close(fd);
+    unlink(tmpPath.c_str());
+    return false;
+  }
+
+  bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+  auto writeColumn = [&ok, fp](const void* data, size_t size, size_t count) {
+    ok = ok && fwrite(data, size, count, fp) == count;
+  };
+  writeColumn(statuses.data(), sizeof(uint32_t), statuses.size());
+  writeColumn(category_.data(), sizeof(CategoryId), category_.size());
+  for (const auto& column : texts_) {
+    writeColumn(column.data(), sizeof(TextRef), column.size());
+  }
+  for (const auto& column : versions_) {
+    writeColumn(column.data(), sizeof(KeysRef), column.size());
+  }
+  writeColumn(slots_.data(), sizeof(PkgId), slots_.size());
+  writeColumn(memberOffsets.data(), sizeof(uint32_t), memberOffsets.size());
+  writeColumn(memberIds.data(), sizeof(uint32_t), memberIds.size());
+  writeColumn(sortedCategories_.data(), sizeof(CategoryId), sortedCategories_.size());
+  writeColumn(versionKeys_.data(), sizeof(Version::Key), versionKeys_.size());
+  writeColumn(names.data(), 1, names.size());
+  ok = ok && arena_.write(fp);
+  ok = ok && descriptions_.write(fp);
+
+  if (fclose(fp) != 0 || !ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+    unlink(tmpPath.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+// Map the snapshot in memory if it matches the given fingerprint. The
+// columns are copied as they need to be modified, but the text arena,
+// which makes up most of the snapshot, stays in the mapping. As anybody
+// owning the home directory can write the snapshot, the sizes, offsets
+// and identifiers it holds are all checked before being used.
+bool Pkg::Store::load(const std::string& path, uint64_t fingerprint) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat sb;
+  void* mapping = MAP_FAILED;
+  if (fstat(fd, &sb) == 0 && static_cast<size_t>(sb.st_size) >= sizeof(SnapshotHeader)) {
+    mapping = mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+
+  const char* cursor = static_cast<const char*>(mapping);
+  SnapshotHeader header;
+  memcpy(&header, cursor, sizeof(header));
+  cursor += sizeof(header);
+
+  // Counts larger than the file are bogus, and would overflow below
+  uint64_t fileSize = sb.st_size;
+  for (uint64_t count : {header.numPkgs, header.numCategories, header.numSlots,
+                         header.numVersionKeys, header.namesSize, header.arenaSize,
+                         header.numDescriptions, header.numDescriptionBlocks,
+                         header.descriptionsSize}) {
+    if (count > fileSize) {
+      munmap(mapping, sb.st_size);
+      return false;
+    }
+  }
+
+  size_t expectedSize = sizeof(header)
+    + header.numPkgs * (sizeof(uint32_t) + sizeof(CategoryId)
+                        + numTexts * sizeof(TextRef) + numVersions * sizeof(KeysRef)
+                        + sizeof(uint32_t))
+    + header.numSlots * sizeof(PkgId)
+    + (header.numCategories + 1) * sizeof(uint32_t)
+    + header.numCategories * sizeof(CategoryId)
+    + header.numVersionKeys * sizeof(Version::Key)
+    + header.namesSize
+    + header.arenaSize
+    + header.numDescriptions * sizeof(DescriptionStore::Entry)
+    + header.numDescriptionBlocks * sizeof(DescriptionStore::Block)
+    + header.descriptionsSize;
+  if (memcmp(header.magic, snapshotMagic, sizeof(header.magic)) != 0
+      || header.version != snapshotVersion
+      || header.fingerprint != fingerprint
+      || expectedSize != static_cast<size_t>(sb.st_size)) {
+    munmap(mapping, sb.st_size);
+    return false;
+  }
+
+  clear();
+  mapping_ = mapping;
+  mappingSize_ = sb.st_size;
+
+  auto readColumn = [&cursor](void* data, size_t size, size_t count) {
+    memcpy(data, cursor, size * count);
+    cursor += size * count;
+  };
+  std::vector<uint32_t> statuses(header.numPkgs);
+  readColumn(statuses.data(), sizeof(uint32_t), statuses.size());
+  for (auto& bitmap : statuses_) {
+    bitmap.resize(header.numPkgs);
+  }
+  for (PkgId id = 0; id < header.numPkgs; ++id) {
+    Status status(statuses[id]);
+    for (size_t bit = 0; bit < numStatuses; ++bit) {
+      statuses_[bit].set(id, status[bit]);
+    }
+  }
+  category_.resize(header.numPkgs);
+  readColumn(category_.data(), sizeof(CategoryId), category_.size());
+  for (auto& column : texts_) {
+    column.resize(header.numPkgs);
+    readColumn(column.data(), sizeof(TextRef), column.size());
+  }
+  for (auto& column : versions_) {
+    column.resize(header.numPkgs);
+    readColumn(column.data(), sizeof(KeysRef), column.size());
+  }
+  slots_.resize(header.numSlots);
+  readColumn(slots_.data(), sizeof(PkgId), slots_.size());
+  std::vector<uint32_t> memberOffsets(header.numCategories + 1);
+  readColumn(memberOffsets.data(), sizeof(uint32_t), memberOffsets.size());
+  std::vector<uint32_t> memberIds(header.numPkgs);
+  readColumn(memberIds.data(), sizeof(uint32_t), memberIds.size());
+  if (memberOffsets.front() != 0 || memberOffsets.back() != header.numPkgs
+      || !std::is_sorted(memberOffsets.begin(), memberOffsets.end())
+      || !allBelow(memberIds, header.numPkgs)
+      || !allBelow(category_, header.numCategories)) {
+    clear();
+    return false;
+  }
+  for (size_t category = 0; category < header.numCategories; ++category) {
+    members_.emplace_back(memberIds.begin() + memberOffsets[category],
+                          memberIds.begin() + memberOffsets[category + 1]);
+    sortedMembers_.push_back(members_.back().size());
+  }
+  sortedCategories_.resize(header.numCategories);
+  readColumn(sortedCategories_.data(), sizeof(CategoryId), sortedCategories_.size());
+  versionKeys_.resize(header.numVersionKeys);
+  readColumn(versionKeys_.data(), sizeof(Version::Key), versionKeys_.size());
+  if (!allBelow(sortedCategories_, header.numCategories)
+      || (header.namesSize != 0 && cursor[header.namesSize - 1] != '\0')) {
+    clear();
+    return false;
+  }
+  for (const char* name = cursor; name < cursor + header.namesSize; name += strlen(name) + 1) {
+    categoryIndex_.emplace(name, categoryNames_.size());
+    categoryNames_.push_back(name);
+  }
+  cursor += header.namesSize;
+  arena_.borrow(cursor, header.arenaSize);
+  cursor += header.arenaSize;
+  bool valid = categoryNames_.size() == header.numCategories
+    && descriptions_.borrow(cursor,
+                            header.numDescriptions,
+                            header.numDescriptionBlocks,
+                            header.descriptionsSize);
+  for (size_t column = 0; valid && column < numTexts; ++column) {
+    for (const auto& ref : texts_[column]) {
+      if (column == Text::description ? ref.length != 0 && ref.offset >= header.numDescriptions
+                                      : static_cast<uint64_t>(ref.offset) + ref.length > header.arenaSize) {
+        valid = false;
+        break;
+      }
+    }
+  }
+  for (const auto& column : versions_) {
+    for (const auto& ref : column) {
+      valid = valid && static_cast<uint64_t>(ref.offset) + ref.length <= header.numVersionKeys;
+    }
+  }
+  // Probing needs a power of two number of slots, some of them empty
+  size_t emptySlots = 0;
+  for (const auto& id : slots_) {
+    emptySlots += id == emptySlot;
+    valid = valid && (id == emptySlot || id < header.numPkgs);
+  }
+  if (!valid || (slots_.size() & (slots_.size() - 1)) != 0
+      || (!slots_.empty() && emptySlots == 0)
+      || (slots_.empty() && header.numPkgs != 0)) {
+    clear();
+    return false;
+  }
+  position_.resize(size());
+  for (CategoryId category = 0; category < members_.size(); ++category) {
+    updatePositions(category);
+  }
+
+  return true;
+}
+
+// Positions change when ports are added to a category, so its bitmaps
+// are rebuilt along with them. position_ must already be large enough.
+void Pkg::Store::updatePositions(CategoryId category) {
+  const std::vector<PkgId>& ids = members_[category];
+  for (unsigned int position = 0; position < ids.size(); ++position) {
+    position_[ids[position]] = position;
+  }
+
+  for (size_t bit = 0; bit < numStatuses; ++bit) {
+    std::vector<Bitmap>& bitmaps = categoryStatuses_[bit];
+    bitmaps.resize(members_.size());
+    bitmaps[category].clear();
+    bitmaps[category].resize(ids.size());
+    for (unsigned int position = 0; position < ids.size(); ++position) {
+      if (statuses_[bit].test(ids[position])) {
+        bitmaps[category].set(position);
+      }
+    }
+  }
+}
+
+Pkg::Status Pkg::Store::status(PkgId id) const {
+  Status status;
+  for (size_t bit = 0; bit < numStatuses; ++bit) {
+    status[bit] = statuses_[bit].test(id);
+  }
+
+  return status;
+}
+
+// The bitmap of the category is only updated once the port got a
+// position, that is when the store was sorted after its insertion.
+void Pkg::Store::setStatus(PkgId id, Statuses bit, bool value) {
+  statuses_[bit].set(id, value);
+  if (id < position_.size()) {
+    categoryStatuses_[bit][category_[id]].set(position_[id], value);
+  }
+}
+
+void Pkg::Store::setStatus(PkgId id, const Status& status) {
+  for (size_t bit = 0; bit < numStatuses; ++bit) {
+    setStatus(id, static_cast<Statuses>(bit), status[bit]);
+  }
+}
+
+void Pkg::Store::resetStatus(Statuses bit) {
+  statuses_[bit].reset();
+  for (auto& bitmap : categoryStatuses_[bit]) {
+    bitmap.reset();
+  }
+}
+
+void Pkg::Store::unmap() {
+  if (mapping_ != nullptr) {
+    arena_.clear();
+    descriptions_.clear();
+    munmap(mapping_, mappingSize_);
+    mapping_ = nullptr;
+    mappingSize_ = 0;
+  }
+}
+
+}
@@ -63,6 +63,7 @@ PopupWindow::PopupWindow(const std::string& msg, Type type, const Point& center)
   setStyle(style);
 
   print(msg);
+  draw();
   Gfx::instance().update();
 
   int duration;
@@ -76,7 +77,10 @@ PopupWindow::PopupWindow(const std::string& msg, Type type, const Point& center)
   }
   std::this_thread::sleep_for(std::chrono::milliseconds(duration));
   clear();
+  draw();
   Gfx::instance().update();
+  // The windows below were blanked and must be drawn again
+  Gfx::instance().damage();
 }
 
 }
@@ -28,29 +28,74 @@
 #include <unistd.h>
 #include <cstdlib>
 
+#include <chrono>
 #include <stdexcept>
 #include <iostream>
 
 #include "ui.h"
 #include "event.h"
+#include "framescheduler.h"
 #include "pkg.h"
+#include "pkgbackend.h"
+#include "fixturebackend.h"
 
 using namespace portal;
 
+// Interval at which the packages loaded in the background, and the
+// results of searches and descriptions fetched in the background, are
+// shown
+static const int loadingTickMs = 20;
+
+// Interval at which changes made to the catalogues by others are shown
+static const int watchingTickMs = 500;
+
+// Time to wait for input before the event loop ticks, if at all
+static int getTickMs() {
+  if (Pkg::instance().isLoading() || Pkg::instance().isLoadingGraph()
+      || Pkg::instance().isSearching() || Pkg::instance().isLoadingDescriptions()) {
+    return loadingTickMs;
+  }
+  return Pkg::instance().isWatching() ? watchingTickMs : -1;
+}
+
 void version(void) {
   std::cout << "portal " << VERSION << std::endl;
   exit(0);
 }
 
 void usage(void) {
-  std::cerr << "usage: portal [-v]" << std::endl;
+  std::cerr << "usage: portal [-lnv] [-f directory] [-j jobs] [-r rate]" << std::endl;
   exit(1);
 }
 
 int main(int argc, char** argv) {
   int opt;
-  while ((opt = getopt(argc, argv, "v")) != -1) {
+  int jobs = 1;
+  int maxFps = FrameScheduler::defaultMaxFps;
+  const char* fixtures = nullptr;
+  while ((opt = getopt(argc, argv, "f:j:lnr:v")) != -1) {
     switch (opt) {
+    case 'f':
+      fixtures = optarg;
+      break;
+    case 'j':
+      jobs = atoi(optarg);
+      if (jobs < 1) {
+        usage();
+      }
+      break;
+    case 'l':
+      Pkg::instance().setLazyDescriptions(true);
+      break;
+    case 'n':
+      Pkg::instance().setUseSnapshot(false);
+      break;
+    case 'r':
+      maxFps = atoi(optarg);
+      if (maxFps < 1) {
+        usage();
+      }
+      break;
     case 'v':
       version();
       break;
@@ -59,19 +104,49 @@ int main(int argc, char** argv) {
     }
   }
 
-  Pkg::instance().reload();
+  try {
+    if (fixtures != nullptr) {
+      Pkg::instance().setBackend(std::unique_ptr<Backend>(new FixtureBackend(fixtures)));
+    } else {
+      Pkg::instance().setBackend(std::unique_ptr<Backend>(new PkgBackend(jobs)));
+    }
+  }
+  catch (std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    exit(1);
+  }
+
+  // The interface comes up first and shows the packages as they are
+  // loaded, the event loop ticking meanwhile to merge them.
+  auto start = std::chrono::steady_clock::now();
+  Pkg::instance().startLoading();
+  Pkg::instance().startWatching();
   Ui::instance().display();
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  syslog(LOG_INFO, "portal: first frame displayed after %.3fs", elapsed.count());
 
+  // Input is handled as it comes, keys held down being folded together,
+  // and the frames showing its effect are displayed at most maxFps times
+  // per second, once no more input is waiting.
+  FrameScheduler frames(maxFps);
   try {
     Event event;
-    while (event.poll()) {
+    while (event.poll(frames.getTimeoutMs(getTickMs()))) {
+      frames.eventReceived(event);
       Ui::instance().handleEvent(event);
-      Ui::instance().display();
+      if (frames.isFrameDue() && !Event::isPending()) {
+        Ui::instance().display();
+        frames.frameDisplayed();
+      }
     }
   }
   catch (std::exception& e) {
     syslog(LOG_ERR, "%s", e.what());
   }
 
+  FrameScheduler::Latency latency = frames.getLatency();
+  syslog(LOG_INFO, "portal: %u frames displayed after input, latency %.1fms mean, %.1fms max",
+         latency.frames, latency.meanMs, latency.maxMs);
+
   return 0;
 }
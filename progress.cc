@@ -0,0 +1,112 @@
+/*-
+ * Copyright (c) 2016 Frederic Culot <culot@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+
+#include "progress.h"
+
+namespace portal {
+
+void Progress::start() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  state_ = State();
+  jobsDone_ = jobDone_ = jobTotal_ = 0;
+  jobsBytes_ = 0;
+  start_ = std::chrono::steady_clock::now();
+}
+
+// The expected number of packages is only an estimate, replaced by the
+// actual one as soon as the backend knows it.
+void Progress::beginJob(size_t expectedPackages) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  jobDone_ = 0;
+  jobTotal_ = expectedPackages;
+  jobsBytes_ = state_.bytesTotal;
+  state_.done = jobsDone_;
+  state_.total = jobsDone_ + jobTotal_;
+}
+
+void Progress::endJob() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  jobsDone_ += jobTotal_;
+  jobDone_ = jobTotal_ = 0;
+  state_.step = Step::idle;
+  state_.package.clear();
+  state_.done = state_.total = jobsDone_;
+}
+
+// Packages are numbered from 1 within a job, and the packages preceding
+// the current one are considered done once it is installed or removed.
+// Fetches are numbered on their own, as cached packages are not fetched.
+void Progress::setPackage(Step step, const std::string& package, size_t index, size_t count) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  state_.step = step;
+  state_.package = package;
+  if (step != Step::fetching) {
+    jobTotal_ = count;
+    jobDone_ = index > 0 ? index - 1 : 0;
+  }
+  state_.done = jobsDone_ + jobDone_;
+  state_.total = jobsDone_ + jobTotal_;
+}
+
+void Progress::addBytesTotal(uint64_t bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  state_.bytesTotal += bytes;
+}
+
+// Number of bytes fetched by the current job
+void Progress::setBytesFetched(uint64_t bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  state_.bytesFetched = std::min(jobsBytes_ + bytes, state_.bytesTotal);
+}
+
+void Progress::addError(const std::string& message) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  state_.errors.push_back(message);
+}
+
+// The time left is extrapolated from the time elapsed so far, fetching
+// and installing being deemed to take as long as each other when there
+// is something to fetch.
+Progress::State Progress::state() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  State state(state_);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_;
+  state.elapsed = elapsed.count();
+
+  double fraction = state.total > 0 ? static_cast<double>(state.done) / state.total : 0;
+  if (state.bytesTotal > 0) {
+    fraction = (fraction + static_cast<double>(state.bytesFetched) / state.bytesTotal) / 2;
+  }
+  if (fraction > 0) {
+    state.eta = state.elapsed * (1 - fraction) / fraction;
+  }
+
+  return state;
+}
+
+}
@@ -0,0 +1,81 @@
+/*-
+ * Copyright (c) 2016 Frederic Culot <culot@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace portal {
+
+// Progress of a transaction, reported by the backend running it and
+// read by the user interface from another thread. A transaction is made
+// of one or several jobs, each one installing or removing a set of
+// packages.
+class Progress {
+ public:
+  enum class Step {
+    idle,
+    fetching,
+    installing,
+    removing
+  };
+
+  struct State {
+    Step                      step {Step::idle};
+    std::string               package;
+    size_t                    done {0};          // packages installed or removed
+    size_t                    total {0};
+    uint64_t                  bytesFetched {0};
+    uint64_t                  bytesTotal {0};
+    double                    elapsed {0};       // seconds
+    double                    eta {-1};          // seconds, negative if unknown
+    std::vector<std::string>  errors;
+  };
+
+  void   start();
+  void   beginJob(size_t expectedPackages);
+  void   endJob();
+  void   setPackage(Step step, const std::string& package, size_t index, size_t count);
+  void   addBytesTotal(uint64_t bytes);
+  void   setBytesFetched(uint64_t bytes);
+  void   addError(const std::string& message);
+  State  state() const;
+
+ private:
+  mutable std::mutex                     mutex_;
+  State                                  state_;
+  size_t                                 jobsDone_ {0};
+  size_t                                 jobDone_ {0};
+  size_t                                 jobTotal_ {0};
+  uint64_t                               jobsBytes_ {0};
+  std::chrono::steady_clock::time_point  start_;
+};
+
+}
@@ -25,6 +25,7 @@
  */
 
 #include <curses.h>
+#include <algorithm>
 
 #include "scrollwindow.h"
 
@@ -32,6 +33,9 @@
 namespace portal {
 namespace gfx {
 
+// Rows kept in the pad of a virtualized window above and below the view
+static const int rowMargin = 8;
+
 ScrollWindow::ScrollWindow(const Size& size, const Point& pos, const Style& style)
   : Window(size, pos, style) {
   sizePad_.setWidth(size.width() - 2);
@@ -43,16 +47,91 @@ ScrollWindow::~ScrollWindow() {
   delwin(pad_);
 }
 
+void ScrollWindow::setRowProvider(const RowProvider& provider) {
+  rowProvider_ = provider;
+  sizePad_.setHeight(size().height() + 2 * rowMargin);
+  wresize(pad_, sizePad_.height(), sizePad_.width());
+  clear();
+}
+
+void ScrollWindow::setNumRows(int numRows) {
+  numRows_ = numRows;
+  rowsStale_ = true;
+  dirtyRows_.clear();
+  damage();
+}
+
+void ScrollWindow::updateRow(int index) {
+  if (isRowInPad(index)) {
+    dirtyRows_.push_back(index);
+    damage();
+  }
+}
+
+// Rows following the inserted ones are moved down within the pad, the
+// last ones falling off its end.
+void ScrollWindow::insertRows(int index, int count) {
+  numRows_ += count;
+  damage();
+  if (index < firstPadRow_) {
+    rowsStale_ = true;
+    return;
+  }
+  if (isRowInPad(index)) {
+    resetCursorLineStyle();
+    wmove(pad_, index - firstPadRow_, 0);
+    winsdelln(pad_, count);
+  }
+  for (int row = index; row < index + count && isRowInPad(row); ++row) {
+    dirtyRows_.push_back(row);
+  }
+}
+
+// Rows following the removed ones are moved up within the pad, and the
+// lines left blank at its end are filled with the rows coming next.
+void ScrollWindow::removeRows(int index, int count) {
+  bool inPad = isRowInPad(index);
+  numRows_ -= count;
+  damage();
+  if (index < firstPadRow_) {
+    rowsStale_ = true;
+    return;
+  }
+  if (!inPad) {
+    return;
+  }
+
+  resetCursorLineStyle();
+  wmove(pad_, index - firstPadRow_, 0);
+  winsdelln(pad_, -count);
+  int firstBlankRow = std::max(index, firstPadRow_ + sizePad_.height() - count);
+  for (int row = firstBlankRow; isRowInPad(row); ++row) {
+    dirtyRows_.push_back(row);
+  }
+}
+
 int ScrollWindow::getCursorRowNum() const {
   return posCursor_.y();
 }
 
+// Compose the window if it changed since last drawn: the borders, the
+// cursor line and the scroll bar are only drawn once per frame, however
+// many lines were printed.
 void ScrollWindow::draw() const {
+  if (!isDamaged()) {
+    return;
+  }
+  if (isOverwritten()) {
+    touchwin(pad_);
+  }
   Window::draw();
+  if (rowProvider_) {
+    renderRows();
+  }
   applyCursorLineStyle();
   drawScrollBar();
   pnoutrefresh(pad_,
-               posPad_.y(),
+               posPad_.y() - firstPadRow_,
                posPad_.x(),
                position().y() + (style().borders ? 1 : 0),
                position().x() + 1,
@@ -61,7 +140,11 @@ void ScrollWindow::draw() const {
 }
 
 void ScrollWindow::clear() {
+  if (rowProvider_) {
+    setNumRows(0);
+  }
   clearPrintArea();
+  damage();
 }
 
 void ScrollWindow::newline() {
@@ -70,32 +153,21 @@ void ScrollWindow::newline() {
 }
 
 void ScrollWindow::print(const std::string& line, const Style& style) {
-  int xpos;
-  switch (style.align) {
-  case Style::Alignment::left:
-    xpos = posPad_.x();
-    break;
-  case Style::Alignment::center:
-    xpos = (size().width() - line.length()) / 2;
-    break;
-  case Style::Alignment::right:
-    xpos = size().width() - line.length() - 2 - (Window::style().borders ? 2 : 0);
-    break;
-  }
-
-  mvwaddstr(pad_, posPrint_.y(), xpos, line.c_str());
-  draw();
+  mvwaddstr(pad_, posPrint_.y(), alignedColumn(line.length(), style.align), line.c_str());
+  damage();
 }
 
 void ScrollWindow::scrollDown() {
   if (canScrollDown()) {
     posPad_.setY(posPad_.y() + 1);
+    damage();
   }
 }
 
 void ScrollWindow::scrollUp() {
   if (canScrollUp()) {
     posPad_.setY(posPad_.y() - 1);
+    damage();
   }
 }
 
@@ -103,6 +175,7 @@ void ScrollWindow::moveCursorDown() {
   if (!isCursorOnLastLine()) {
     resetCursorLineStyle();
     posCursor_.setY(posCursor_.y() + 1);
+    damage();
     if (isCursorOnLastVisibleLine()) {
       scrollDown();
     }
@@ -113,6 +186,7 @@ void ScrollWindow::moveCursorUp() {
   if (!isCursorOnFirstLine()) {
     resetCursorLineStyle();
     posCursor_.setY(posCursor_.y() - 1);
+    damage();
     if (isCursorOnFirstVisibleLine()) {
       scrollUp();
     }
@@ -123,23 +197,95 @@ void ScrollWindow::resetCursorPosition() {
   posCursor_.setX(0);
   posCursor_.setY(0);
   posPad_.setY(0);
+  damage();
 }
 
 void ScrollWindow::colorizeCurrentLine(short cursesColorNum) const {
   mvwchgat(pad_,
-           posCursor_.y(),
+           posCursor_.y() - firstPadRow_,
            0,
            sizePad_.width(),
            A_NORMAL,
            cursesColorNum,
            nullptr);
+  damage();
 }
 
 void ScrollWindow::createPad() {
   pad_ = newpad(sizePad_.height(), sizePad_.width());
 }
 
+// Ask for the rows in view if they changed, or if the view moved past
+// the rows held by the pad. The margin kept on both sides of the view
+// saves asking for them again each time the cursor moves by a line.
+// Otherwise only the rows marked as dirty are asked again.
+void ScrollWindow::renderRows() const {
+  int viewHeight = size().height();
+  if (!rowsStale_
+      && posPad_.y() >= firstPadRow_
+      && posPad_.y() + viewHeight <= firstPadRow_ + sizePad_.height()) {
+    for (int index : dirtyRows_) {
+      if (isRowInPad(index)) {
+        wmove(pad_, index - firstPadRow_, 0);
+        wclrtoeol(pad_);
+        renderRow(index);
+      }
+    }
+    dirtyRows_.clear();
+    return;
+  }
+
+  werase(pad_);
+  firstPadRow_ = std::max(0, posPad_.y() - rowMargin);
+  int lastRow = std::min(numRows_, firstPadRow_ + sizePad_.height());
+  for (int index = firstPadRow_; index < lastRow; ++index) {
+    renderRow(index);
+  }
+  rowsStale_ = false;
+  dirtyRows_.clear();
+}
+
+void ScrollWindow::renderRow(int index) const {
+  row_.text.clear();
+  row_.rightText.clear();
+  rowProvider_(index, row_);
+
+  int line = index - firstPadRow_;
+  mvwaddstr(pad_, line, alignedColumn(row_.text.length(), Style::Alignment::left),
+            row_.text.c_str());
+  if (!row_.rightText.empty()) {
+    mvwaddstr(pad_, line, alignedColumn(row_.rightText.length(), Style::Alignment::right),
+              row_.rightText.c_str());
+  }
+}
+
+bool ScrollWindow::isRowInPad(int index) const {
+  return !rowsStale_
+    && index >= firstPadRow_
+    && index < std::min(numRows_, firstPadRow_ + sizePad_.height());
+}
+
+int ScrollWindow::numLines() const {
+  return rowProvider_ ? numRows_ : posPrint_.y();
+}
+
+int ScrollWindow::alignedColumn(size_t length, Style::Alignment align) const {
+  switch (align) {
+  case Style::Alignment::left:
+    break;
+  case Style::Alignment::center:
+    return (size().width() - length) / 2;
+  case Style::Alignment::right:
+    return size().width() - length - 2 - (style().borders ? 2 : 0);
+  }
+
+  return posPad_.x();
+}
+
 void ScrollWindow::extendPrintArea() {
+  if (rowProvider_) {
+    return;
+  }
   if (posPrint_.y() == sizePad_.height() - 1) {
     sizePad_.setHeight(sizePad_.height() * 2);
     wresize(pad_, sizePad_.height(), sizePad_.width());
@@ -177,12 +323,12 @@ void ScrollWindow::drawScrollBar() const {
 
 void ScrollWindow::applyCursorLineStyle() const {
   if (style().highlight) {
-    mvwchgat(pad_, posCursor_.y(), 0, sizePad_.width(), A_REVERSE, 0, nullptr);
+    mvwchgat(pad_, posCursor_.y() - firstPadRow_, 0, sizePad_.width(), A_REVERSE, 0, nullptr);
   }
 }
 
 void ScrollWindow::resetCursorLineStyle() const {
-  mvwchgat(pad_, posCursor_.y(), 0, sizePad_.width(), A_NORMAL, 0, nullptr);
+  mvwchgat(pad_, posCursor_.y() - firstPadRow_, 0, sizePad_.width(), A_NORMAL, 0, nullptr);
 }
 
 bool ScrollWindow::isCursorOnFirstLine() const {
@@ -190,7 +336,7 @@ bool ScrollWindow::isCursorOnFirstLine() const {
 }
 
 bool ScrollWindow::isCursorOnLastLine() const {
-  return posCursor_.y() == posPrint_.y() - (style().borders ? 1 : 0);
+  return posCursor_.y() == numLines() - (style().borders ? 1 : 0);
 }
 
 bool ScrollWindow::isCursorOnFirstVisibleLine() const {
@@ -206,7 +352,7 @@ bool ScrollWindow::canScrollUp() const {
 }
 
 bool ScrollWindow::canScrollDown() const {
-  return posPrint_.y() - posPad_.y() > size().height() - (style().borders ? 2 : 0);
+  return numLines() - posPad_.y() > size().height() - (style().borders ? 2 : 0);
 }
 
 }
@@ -26,8 +26,10 @@
 
 #pragma once
 
+#include <functional>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "gfx.h"
 #include "window.h"
@@ -37,10 +39,28 @@ namespace gfx {
 
 class ScrollWindow : public Window {
  public:
+  // A row of a virtualized window: text is printed from the left, and
+  // rightText aligned to the right.
+  struct Row {
+    std::string text;
+    std::string rightText;
+  };
+  using RowProvider = std::function<void(int index, Row& row)>;
 
   ScrollWindow(const Size& size, const Point& pos, const Style& style = {});
   ~ScrollWindow();
 
+  // Once given a row provider, the window does not hold its contents
+  // anymore: only the rows in view, and a few around them, are asked
+  // for when drawn. They are all asked again after setNumRows(), while
+  // updateRow(), insertRows() and removeRows() only ask for the rows
+  // they touch. The cursor and the view stay where they are.
+  void setRowProvider(const RowProvider& provider);
+  void setNumRows(int numRows);
+  void updateRow(int index);
+  void insertRows(int index, int count);
+  void removeRows(int index, int count);
+
   int  getCursorRowNum() const;
   void draw() const;
   void clear();
@@ -89,7 +109,22 @@ class ScrollWindow : public Window {
   Point posCursor_;
   Point posPrint_;
 
+  // Rows of a virtualized window. The pad then only holds the rows from
+  // firstPadRow_ on, and rows are identified by index everywhere else.
+  // Rows held by the pad but changed since are listed in dirtyRows_.
+  RowProvider                rowProvider_;
+  int                        numRows_ {0};
+  mutable int                firstPadRow_ {0};
+  mutable bool               rowsStale_ {true};
+  mutable std::vector<int>   dirtyRows_;
+  mutable Row                row_;
+
   void createPad();
+  void renderRows() const;
+  void renderRow(int index) const;
+  bool isRowInPad(int index) const;
+  int  numLines() const;
+  int  alignedColumn(size_t length, Style::Alignment align) const;
   void extendPrintArea();
   void clearPrintArea();
   void drawScrollBar() const;
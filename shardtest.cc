@@ -0,0 +1,107 @@
+/*-
+ * Copyright (c) 2016 Frederic Culot <culot@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifdef WITH_SQLITE
+#include <sqlite3.h>
+#endif
+
+#include "pkgbackend.h"
+
+// Checks that the shards fetching the remote catalogue in parallel
+// return every category exactly once, whatever their number.
+
+namespace {
+
+const char* const categories[] = {
+  "accessibility", "arabic", "archivers", "astro", "audio", "benchmarks",
+  "biology", "cad", "chinese", "comms", "converters", "databases",
+  "deskutils", "devel", "dns", "editors", "emulators", "finance", "french",
+  "ftp", "games", "german", "graphics", "hebrew", "hungarian", "irc",
+  "japanese", "java", "korean", "lang", "mail", "math", "misc",
+  "multimedia", "net", "net-im", "net-mgmt", "net-p2p", "news", "polish",
+  "ports-mgmt", "portuguese", "print", "russian", "science", "security",
+  "shells", "sysutils", "textproc", "ukrainian", "vietnamese", "www", "x11",
+  "x11-clocks", "x11-drivers", "x11-fm", "x11-fonts", "x11-servers",
+  "x11-themes", "x11-toolkits", "x11-wm", "zh-games"
+};
+
+#ifdef WITH_SQLITE
+bool matches(const std::string& glob, const std::string& origin) {
+  return sqlite3_strglob(glob.c_str(), origin.c_str()) == 0;
+}
+#else
+// The subset of the GLOB of SQLite used by the shards: a leading class,
+// negated by ^, followed by *
+bool matches(const std::string& glob, const std::string& origin) {
+  if (glob == "*") {
+    return true;
+  }
+  size_t end = glob.find(']');
+  if (glob[0] != '[' || end == std::string::npos || glob.substr(end) != "]*") {
+    return false;
+  }
+  bool negated = glob[1] == '^';
+  bool inClass = false;
+  for (size_t i = negated ? 2 : 1; i < end; ++i) {
+    if (i + 2 < end && glob[i + 1] == '-') {
+      inClass |= origin[0] >= glob[i] && origin[0] <= glob[i + 2];
+      i += 2;
+    } else {
+      inClass |= origin[0] == glob[i];
+    }
+  }
+  return inClass != negated;
+}
+#endif
+
+}
+
+int main() {
+  int failures = 0;
+  int runs = 0;
+  for (unsigned int shards = 1; shards <= 30; ++shards) {
+    std::vector<std::string> globs = portal::PkgBackend::getShardGlobs(shards);
+    for (const char* category : categories) {
+      std::string origin = std::string(category) + "/port";
+      int matched = 0;
+      for (const auto& glob : globs) {
+        matched += matches(glob, origin);
+      }
+      if (matched != 1) {
+        printf("%u shards: %s matched by %d of them\n", shards, origin.c_str(), matched);
+        ++failures;
+      }
+      ++runs;
+    }
+  }
+  printf("%d cases, %d failed\n", runs, failures);
+
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,65 @@
+/*-
+ * Copyright (c) 2016 Frederic Culot <culot@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdexcept>
+
+#include "textarena.h"
+
+namespace portal {
+
+void TextArena::clear() {
+  base_ = nullptr;
+  baseSize_ = 0;
+  owned_.clear();
+}
+
+void TextArena::borrow(const char* base, size_t size) {
+  if (!owned_.empty()) {
+    throw std::logic_error("TextArena::borrow(): arena is not empty");
+  }
+  base_ = base;
+  baseSize_ = size;
+}
+
+TextArena::Ref TextArena::append(const char* text, size_t len) {
+  if (size() + len > UINT32_MAX) {
+    throw std::length_error("TextArena::append(): arena is full");
+  }
+
+  Ref ref;
+  ref.offset = size();
+  ref.length = len;
+  owned_.insert(owned_.end(), text, text + len);
+
+  return ref;
+}
+
+bool TextArena::write(FILE* fp) const {
+  return fwrite(base_, 1, baseSize_, fp) == baseSize_
+    && fwrite(owned_.data(), 1, owned_.size(), fp) == owned_.size();
+}
+
+}
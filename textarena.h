@@ -0,0 +1,62 @@
+/*-
+ * Copyright (c) 2016 Frederic Culot <culot@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace portal {
+
+// Append-only buffer holding strings referenced by offset and length.
+// The first part of the arena can be borrowed from read-only memory,
+// such as a mapped file, in which case new strings are appended to an
+// owned buffer that logically follows it.
+class TextArena {
+ public:
+  struct Ref {
+    uint32_t offset {0};
+    uint32_t length {0};
+  };
+
+  void         clear();
+  void         borrow(const char* base, size_t size);
+  Ref          append(const char* text, size_t len);
+  size_t       size() const {return baseSize_ + owned_.size();}
+  bool         write(FILE* fp) const;
+
+  const char*  data(const Ref& ref) const {
+    return ref.offset < baseSize_ ? base_ + ref.offset : owned_.data() + (ref.offset - baseSize_);
+  }
+
+ private:
+  const char*        base_ {nullptr};
+  size_t             baseSize_ {0};
+  std::vector<char>  owned_;
+};
+
+}
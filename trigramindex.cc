@@ -0,0 +1,217 @@
+/*-
+ * Copyright (c) 2016 Frederic Culot <culot@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <unordered_set>
+
+#include "hash.h"
+#include "trigramindex.h"
+
+namespace portal {
+
+static const uint32_t emptySlot = UINT32_MAX;
+
+// Texts are folded to lower case as in the "C" locale, which is also
+// what the matching done by the callers relies on.
+static uint32_t fold(char c) {
+  return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : static_cast<unsigned char>(c);
+}
+
+static uint32_t trigramAt(const char* text) {
+  return fold(text[0]) << 16 | fold(text[1]) << 8 | fold(text[2]);
+}
+
+void TrigramIndex::clear() {
+  slots_.clear();
+  trigrams_.clear();
+  postings_.clear();
+}
+
+// Texts of a given document are usually added in one go, and documents
+// in increasing order, so that posting lists are kept sorted by simply
+// appending to them. Documents added later on, once their description
+// was loaded or after they were refreshed, are inserted in place.
+void TrigramIndex::add(DocId doc, const char* text, size_t len) {
+  for (size_t i = 0; i + 3 <= len; ++i) {
+    std::vector<DocId>& docs = insert(trigramAt(text + i));
+    if (docs.empty() || docs.back() < doc) {
+      docs.push_back(doc);
+    } else if (docs.back() != doc) {
+      auto it = std::lower_bound(docs.begin(), docs.end(), doc);
+      if (*it != doc) {
+        docs.insert(it, doc);
+      }
+    }
+  }
+}
+
+// Intersect the posting lists of all the trigrams found in the given
+// literals, starting with the shortest ones. Return false if the
+// literals are too short to select anything, in which case every
+// document is a candidate.
+bool TrigramIndex::candidates(const std::vector<std::string>& literals,
+                              std::vector<DocId>& docs) const {
+  std::unordered_set<Trigram> trigrams;
+  for (const auto& literal : literals) {
+    for (size_t i = 0; i + 3 <= literal.length(); ++i) {
+      trigrams.insert(trigramAt(literal.data() + i));
+    }
+  }
+  docs.clear();
+  if (trigrams.empty()) {
+    return false;
+  }
+
+  std::vector<const std::vector<DocId>*> lists;
+  for (const auto& trigram : trigrams) {
+    const std::vector<DocId>* list = find(trigram);
+    if (list == nullptr) {
+      return true;
+    }
+    lists.push_back(list);
+  }
+  std::sort(lists.begin(), lists.end(),
+            [](const std::vector<DocId>* lhs, const std::vector<DocId>* rhs) {
+              return lhs->size() < rhs->size();
+            });
+
+  docs = *lists.front();
+  std::vector<DocId> intersection;
+  for (size_t i = 1; i < lists.size() && !docs.empty(); ++i) {
+    intersection.clear();
+    std::set_intersection(docs.begin(), docs.end(),
+                          lists[i]->begin(), lists[i]->end(),
+                          std::back_inserter(intersection));
+    docs.swap(intersection);
+  }
+
+  return true;
+}
+
+// Extract the literal strings any text matching the given extended
+// regular expression must contain. Alternations and groups could make
+// any part of the expression optional, so no literal is extracted from
+// expressions using them. A character followed by a repetition which
+// allows zero occurrences is left out of the literals.
+std::vector<std::string> TrigramIndex::regexLiterals(const std::string& pattern) {
+  std::vector<std::string> literals;
+  if (pattern.find_first_of("|()") != std::string::npos) {
+    return literals;
+  }
+
+  std::string literal;
+  auto flush = [&]() {
+    if (literal.length() >= 3) {
+      literals.push_back(literal);
+    }
+    literal.clear();
+  };
+
+  for (size_t i = 0; i < pattern.length(); ++i) {
+    switch (pattern[i]) {
+    case '*':
+    case '?':
+    case '{':
+      if (!literal.empty()) {
+        literal.pop_back();
+      }
+      flush();
+      if (pattern[i] == '{') {
+        i = std::min(pattern.find('}', i), pattern.length());
+      }
+      break;
+    case '[':
+      flush();
+      // A closing bracket right after the opening one, possibly
+      // negated, is part of the bracket expression.
+      i += pattern.compare(i + 1, 1, "^") == 0 ? 2 : 1;
+      i = std::min(pattern.find(']', i + 1), pattern.length());
+      break;
+    case '\\':
+      flush();
+      ++i;
+      break;
+    case '.':
+    case '+':
+    case '^':
+    case '$':
+      flush();
+      break;
+    default:
+      literal.push_back(pattern[i]);
+      break;
+    }
+  }
+  flush();
+
+  return literals;
+}
+
+const std::vector<TrigramIndex::DocId>* TrigramIndex::find(Trigram trigram) const {
+  if (slots_.empty()) {
+    return nullptr;
+  }
+
+  uint32_t index = slots_[findSlot(trigram)];
+  return index == emptySlot ? nullptr : &postings_[index];
+}
+
+std::vector<TrigramIndex::DocId>& TrigramIndex::insert(Trigram trigram) {
+  if (2 * (trigrams_.size() + 1) > slots_.size()) {
+    growTable();
+  }
+
+  size_t slot = findSlot(trigram);
+  if (slots_[slot] == emptySlot) {
+    slots_[slot] = trigrams_.size();
+    trigrams_.push_back(trigram);
+    postings_.emplace_back();
+  }
+
+  return postings_[slots_[slot]];
+}
+
+size_t TrigramIndex::findSlot(Trigram trigram) const {
+  size_t mask = slots_.size() - 1;
+  size_t slot = fnv1a(&trigram, sizeof(trigram)) & mask;
+
+  while (slots_[slot] != emptySlot && trigrams_[slots_[slot]] != trigram) {
+    slot = (slot + 1) & mask;
+  }
+
+  return slot;
+}
+
+void TrigramIndex::growTable() {
+  size_t capacity = slots_.empty() ? 4096 : slots_.size() * 2;
+  slots_.assign(capacity, emptySlot);
+
+  for (uint32_t index = 0; index < trigrams_.size(); ++index) {
+    slots_[findSlot(trigrams_[index])] = index;
+  }
+}
+
+}
@@ -0,0 +1,67 @@
+/*-
+ * Copyright (c) 2016 Frederic Culot <culot@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace portal {
+
+// Inverted index mapping every trigram of the indexed texts, folded to
+// lower case, to the sorted list of the documents containing it. It is
+// used to preselect the candidates of a case-insensitive search: every
+// document matching is returned, but some candidates may not match and
+// must be checked by the caller.
+class TrigramIndex {
+ public:
+  using DocId = uint32_t;
+
+  void        clear();
+  void        add(DocId doc, const char* text, size_t len);
+  void        add(DocId doc, const std::string& text) {add(doc, text.data(), text.length());}
+  bool        candidates(const std::vector<std::string>& literals,
+                         std::vector<DocId>& docs) const;
+
+  static std::vector<std::string>  regexLiterals(const std::string& pattern);
+
+ private:
+  using Trigram = uint32_t;
+
+  // Open addressing table of the trigrams seen so far, holding indexes
+  // in trigrams_ and postings_, which are appended to in parallel.
+  std::vector<uint32_t>            slots_;
+  std::vector<Trigram>             trigrams_;
+  std::vector<std::vector<DocId>>  postings_;
+
+  const std::vector<DocId>*  find(Trigram trigram) const;
+  std::vector<DocId>&        insert(Trigram trigram);
+  size_t                     findSlot(Trigram trigram) const;
+  void                       growTable();
+};
+
+}
@@ -24,6 +24,11 @@
  * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <syslog.h>
+#include <cstdio>
+
+#include <algorithm>
+#include <future>
 #include <thread>
 #include <chrono>
 #include <sstream>
@@ -33,7 +38,6 @@
 #include <curses.h>
 
 #include "popupwindow.h"
-#include "inputwindow.h"
 #include "gfx.h"
 #include "ui.h"
 
@@ -43,11 +47,43 @@ const std::string markerCategory("---");
 const std::string markerFolded("-");
 const std::string markerUnfolded("\\");
 
+// Interval at which the progress of pending actions is displayed
+static const int progressTickMs = 100;
+
+static std::string formatSize(uint64_t bytes) {
+  static const char* units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+  double size = bytes;
+  size_t unit = 0;
+  while (size >= 1024 && unit < sizeof(units) / sizeof(units[0]) - 1) {
+    size /= 1024;
+    ++unit;
+  }
+  char buf[16];
+  snprintf(buf, sizeof(buf), unit == 0 ? "%.0f %s" : "%.1f %s", size, units[unit]);
+
+  return buf;
+}
+
+static std::string formatDuration(double seconds) {
+  unsigned long total = static_cast<unsigned long>(seconds + 0.5);
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%lu:%02lu", total / 60, total % 60);
+
+  return buf;
+}
+
+// Keep messages within the width of the screen
+static std::string truncate(const std::string& msg) {
+  size_t width = COLS > 20 ? COLS - 20 : 1;
+  return msg.length() > width ? msg.substr(0, width - 1) + "~" : msg;
+}
+
 Ui::Ui() {
   filters_.set();
   gfx::Gfx::instance().init();
   createInterface();
   updatePanes();
+  updateStatus();
 }
 
 Ui::~Ui() {
@@ -63,21 +99,13 @@ void Ui::display() {
 }
 
 void Ui::handleEvent(const Event& event) {
+  syncPkgList();
+
   switch (event.type()) {
   case Event::Type::nextMode:
     selectNextMode();
     pane_[pkgList]->clearStatus();
-    switch (currentMode_) {
-    case Mode::browse:
-      Pkg::instance().resetFilter();
-      break;
-    case Mode::search:
-      applySearch();
-      break;
-    case Mode::filter:
-      applyFilter();
-      break;
-    }
+    applyCurrentMode();
     updatePanes();
     updateTray();
     updateStatus();
@@ -86,12 +114,10 @@ void Ui::handleEvent(const Event& event) {
   case Event::Type::select: {
     if (!Pkg::instance().isRepositoryEmpty()) {
       if (gotCategorySelected()) {
-        std::string category = getSelectedItemName();
-        toggleCategoryFolding(category);
-        updatePanes();
+        toggleCategoryFolding(pane_[pkgList]->getCursorRowNum());
       } else {
         registerPkgChange(event.type());
-        updatePkgListPane();
+        pane_[pkgList]->updateRow(pane_[pkgList]->getCursorRowNum());
       }
     }
     break;
@@ -100,17 +126,19 @@ void Ui::handleEvent(const Event& event) {
   case Event::Type::deselect:
     if (!Pkg::instance().isRepositoryEmpty()) {
       registerPkgChange(event.type());
-      updatePkgListPane();
+      pane_[pkgList]->updateRow(pane_[pkgList]->getCursorRowNum());
     }
     break;
 
   case Event::Type::keyUp:
   case Event::Type::keyDown:
     if (!Pkg::instance().isRepositoryEmpty()) {
-      if (event.type() == Event::Type::keyUp) {
-        pane_[pkgList]->moveCursorUp();
-      } else if (event.type() == Event::Type::keyDown) {
-        pane_[pkgList]->moveCursorDown();
+      for (int i = 0; i < event.count(); ++i) {
+        if (event.type() == Event::Type::keyUp) {
+          pane_[pkgList]->moveCursorUp();
+        } else if (event.type() == Event::Type::keyDown) {
+          pane_[pkgList]->moveCursorDown();
+        }
       }
       updatePkgDescrPane();
     }
@@ -119,10 +147,12 @@ void Ui::handleEvent(const Event& event) {
   case Event::Type::pageUp:
   case Event::Type::pageDown:
     if (!Pkg::instance().isRepositoryEmpty()) {
-      if (event.type() == Event::Type::pageUp) {
-        pane_[pkgDescr]->scrollUp();
-      } else if (event.type() == Event::Type::pageDown) {
-        pane_[pkgDescr]->scrollDown();
+      for (int i = 0; i < event.count(); ++i) {
+        if (event.type() == Event::Type::pageUp) {
+          pane_[pkgDescr]->scrollUp();
+        } else if (event.type() == Event::Type::pageDown) {
+          pane_[pkgDescr]->scrollDown();
+        }
       }
       updatePkgDescrPane();
     }
@@ -134,11 +164,11 @@ void Ui::handleEvent(const Event& event) {
       // DO NOTHING
       break;
     case Mode::search:
-      pane_[pkgList]->resetCursorPosition();
-      promptSearch(event.character());
-      applySearch();
-      updatePanes();
-      updateStatus();
+      // Function keys come as curses codes beyond the ASCII range
+      if (event.character() >= ' ' && event.character() <= '~') {
+        searchString_.push_back(static_cast<char>(event.character()));
+        startSearch();
+      }
       break;
     case Mode::filter:
       pane_[pkgList]->resetCursorPosition();
@@ -150,18 +180,29 @@ void Ui::handleEvent(const Event& event) {
     }
     break;
 
+  case Event::Type::keyBackspace:
+    if (currentMode_ == Mode::search && !searchString_.empty()) {
+      searchString_.pop_back();
+      startSearch();
+    }
+    break;
+
   case Event::Type::go:
-    if (!Pkg::instance().gotRootPrivileges()) {
+    if (Pkg::instance().isLoading()) {
+      gfx::PopupWindow("Packages list still loading, please retry",
+                       gfx::PopupWindow::Type::warning);
+    } else if (!Pkg::instance().gotRootPrivileges()) {
       gfx::PopupWindow("Insufficient privileges, please retry as root",
                        gfx::PopupWindow::Type::warning);
     } else {
       performPending();
-      closeAllFolds();
+      applyCurrentMode();
       updatePanes();
     }
     break;
 
   case Event::Type::redraw:
+    gfx::Gfx::instance().redraw();
     display();
     break;
 
@@ -202,6 +243,9 @@ void Ui::createInterface() {
 
   pane_[pkgList] = std::unique_ptr<gfx::ScrollWindow>(new gfx::ScrollWindow(listSize, listPos));
   pane_[pkgList]->setStyle(listStyle);
+  pane_[pkgList]->setRowProvider([this](int index, gfx::ScrollWindow::Row& row) {
+      getPkgListRow(index, row);
+    });
   pane_[pkgDescr] = std::unique_ptr<gfx::ScrollWindow>(new gfx::ScrollWindow(descrSize, descrPos));
 
   gfx::Point trayPos;
@@ -222,20 +266,32 @@ void Ui::updatePanes() {
   }
 }
 
+// Items only refer to the storage of the packages, so that the list is
+// rebuilt without allocating once it reached its size.
 void Ui::buildPkgList() {
   pkgList_.clear();
-  std::vector<std::string> categories = Pkg::instance().getPkgCategories();
-  for (const auto& category : categories) {
-    pkgList_.push_back({pkgListItemType::category, category});
-    if (!isCategoryFolded(category)) {
-      std::vector<std::string> origins = Pkg::instance().getPkgOrigins(category);
-      for (const auto& origin : origins) {
-        pkgList_.push_back({pkgListItemType::pkg, origin});
+  for (const auto& category : Pkg::instance().getCategoryIds()) {
+    const std::vector<Pkg::PkgId>& ids = Pkg::instance().getPkgIds(category);
+    if (ids.empty()) {
+      continue;
+    }
+    std::string_view name = Pkg::instance().getCategoryName(category);
+    pkgList_.push_back({pkgListItemType::category, name, category, 0});
+    if (!isCategoryFolded(name)) {
+      for (const auto& id : ids) {
+        pkgList_.push_back({pkgListItemType::pkg, std::string_view(), category, id});
       }
     }
   }
 }
 
+// The list pane only asks for the rows it shows, through
+// getPkgListRow().
+void Ui::updatePkgListPane() {
+  buildPkgList();
+  pane_[pkgList]->setNumRows(pkgList_.size());
+}
+
 // Build a hierarchy of categories and ports:
 //
 // ---- category1
@@ -243,49 +299,158 @@ void Ui::buildPkgList() {
 // -    port1
 // +    port2
 // ---- category3
-void Ui::updatePkgListPane() {
-  buildPkgList();
-  pane_[pkgList]->clear();
-  gfx::Style rightAligned;
-  rightAligned.align = gfx::Style::Alignment::right;
-  for (const auto& item : pkgList_) {
-    switch (item.type) {
-    case pkgListItemType::category: {
-      std::string categoryString = getStringForCategory(item.name);
-      pane_[pkgList]->print(categoryString);
-    }
+void Ui::getPkgListRow(int index, gfx::ScrollWindow::Row& row) const {
+  const pkgListItem& item = pkgList_[index];
+  switch (item.type) {
+  case pkgListItemType::category:
+    row.text = getStringForCategory(item);
     break;
-    case pkgListItemType::pkg: {
-      std::string pkgString = getStringForPkg(item.name);
-      pane_[pkgList]->print(pkgString);
-      std::string pkgVersions = getVersionsForPkg(item.name);
-      pane_[pkgList]->print(pkgVersions, rightAligned);
-    }
+  case pkgListItemType::pkg:
+    row.text = getStringForPkg(item.id);
+    row.rightText = getVersionsForPkg(item.id);
+    break;
+  default:
     break;
-    default:
-      break;
-    }
-    pane_[pkgList]->newline();
   }
 }
 
 void Ui::updatePkgDescrPane() {
   pane_[pkgDescr]->clear();
+  descrLoading_ = false;
+  prefetchDescriptions();
 
   if (!gotCategorySelected()) {
-    std::string origin = getSelectedItemName();
-    std::string comment = Pkg::instance().getPkgAttr(origin, Pkg::Attr::comment);
+    Pkg::PkgId id = getCurrentPkgListItem().id;
+    std::string comment(Pkg::instance().getPkgAttrView(id, Pkg::Attr::comment));
     pane_[pkgDescr]->print(comment);
     pane_[pkgDescr]->colorizeCurrentLine(gfx::Style::Color::cyan);
 
-    std::string desc = Pkg::instance().getPkgAttr(origin, Pkg::Attr::description);
+    // Descriptions fetched on demand are shown by syncPkgList() once
+    // available, a placeholder standing for them meanwhile.
+    descrLoading_ = !Pkg::instance().isDescriptionLoaded(id);
+    std::string desc = Pkg::instance().getPkgAttr(id, Pkg::Attr::description);
+    if (descrLoading_) {
+      desc = "Loading description...";
+    }
     std::stringstream commentStream(desc);
     std::string descLine;
     while (std::getline(commentStream, descLine, '\n')) {
       pane_[pkgDescr]->newline();
       pane_[pkgDescr]->print(descLine);
     }
+    displayDependencyImpact(id);
+  }
+}
+
+// Tell which installed ports would go away together with an installed
+// port, and which ports would be pulled in by installing another one.
+void Ui::displayDependencyImpact(Pkg::PkgId id) {
+  static const size_t maxImpactShown = 20;
+
+  bool installed = !Pkg::instance().getPkgAttrView(id, Pkg::Attr::localVersion).empty();
+  std::vector<std::string> impact = installed ? Pkg::instance().getRemovalImpact(id)
+                                              : Pkg::instance().getInstallImpact(id);
+  if (impact.empty()) {
+    return;
+  }
+
+  std::string heading = installed
+    ? "Required by " + std::to_string(impact.size()) + " installed package(s), removed along with it:"
+    : "Installing it also installs " + std::to_string(impact.size()) + " package(s):";
+  pane_[pkgDescr]->newline();
+  pane_[pkgDescr]->newline();
+  pane_[pkgDescr]->print(heading);
+  pane_[pkgDescr]->colorizeCurrentLine(installed ? gfx::Style::Color::yellow
+                                                 : gfx::Style::Color::cyan);
+  for (size_t i = 0; i < impact.size() && i < maxImpactShown; ++i) {
+    pane_[pkgDescr]->newline();
+    pane_[pkgDescr]->print("  " + impact[i]);
+  }
+  if (impact.size() > maxImpactShown) {
+    pane_[pkgDescr]->newline();
+    pane_[pkgDescr]->print("  and " + std::to_string(impact.size() - maxImpactShown) + " more");
+  }
+}
+
+// Ask for the descriptions of the current port and of those around the
+// cursor, nearest first, so that they are already known when the cursor
+// moves.
+void Ui::prefetchDescriptions() const {
+  int cursor = pane_[pkgList]->getCursorRowNum();
+  int range = pane_[pkgList]->size().height();
+  int numItems = pkgList_.size();
+  std::vector<Pkg::PkgId> ids;
+  if (!isCategory(pkgList_[cursor])) {
+    ids.push_back(pkgList_[cursor].id);
+  }
+  for (int distance = 1; distance <= range; ++distance) {
+    for (int row : {cursor + distance, cursor - distance}) {
+      if (row >= 0 && row < numItems && !isCategory(pkgList_[row])) {
+        ids.push_back(pkgList_[row].id);
+      }
+    }
+  }
+  Pkg::instance().prefetchDescriptions(ids);
+}
+
+// Show the ports loaded in the background since the last event, or
+// the changes made to the catalogues by other pkg(8) invocations. The
+// cursor is kept on the same item while the list changes around it.
+void Ui::syncPkgList() {
+  if (Pkg::instance().mergeDependencyGraph() && !pkgList_.empty()) {
+    updatePkgDescrPane();
+  }
+  if (descrLoading_ && !pkgList_.empty() && !gotCategorySelected()
+      && Pkg::instance().isDescriptionLoaded(getCurrentPkgListItem().id)) {
+    updatePkgDescrPane();
+  }
+  bool rerun = searchRerun_;
+  if (!rerun && Pkg::instance().mergeSearchResults()) {
+    pane_[pkgList]->resetCursorPosition();
+    updatePanes();
+    updateStatus();
+  }
+
+  bool hadItems = !Pkg::instance().isRepositoryEmpty() && !pkgList_.empty();
+  pkgListItem current {pkgListItemType::category, std::string_view(), 0, 0};
+  if (hadItems) {
+    current = getCurrentPkgListItem();
+  }
+
+  bool changed = Pkg::instance().isLoading() ? Pkg::instance().mergeLoadedPorts()
+                                             : Pkg::instance().applyCatalogueChanges();
+  if (changed) {
+    applyCurrentMode();
+  }
+  // The results of a search run again are shown like the changes to the
+  // list which made it necessary.
+  if (rerun && Pkg::instance().mergeSearchResults()) {
+    searchRerun_ = false;
+    changed = true;
+  }
+  if (!changed) {
+    return;
+  }
+  buildPkgList();
+
+  if (hadItems) {
+    auto item = std::find_if(pkgList_.begin(), pkgList_.end(), [&current](const pkgListItem& item) {
+        return item.type == current.type
+          && (item.type == pkgListItemType::category ? item.name == current.name
+                                                      : item.id == current.id);
+      });
+    if (item != pkgList_.end()) {
+      int row = item - pkgList_.begin();
+      while (pane_[pkgList]->getCursorRowNum() < row) {
+        pane_[pkgList]->moveCursorDown();
+      }
+      while (pane_[pkgList]->getCursorRowNum() > row) {
+        pane_[pkgList]->moveCursorUp();
+      }
+    }
   }
+  updatePanes();
+  updateStatus();
 }
 
 const Ui::pkgListItem& Ui::getCurrentPkgListItem() const {
@@ -293,11 +458,6 @@ const Ui::pkgListItem& Ui::getCurrentPkgListItem() const {
   return pkgList_[index];
 }
 
-std::string Ui::getSelectedItemName() const {
-  const pkgListItem& item = getCurrentPkgListItem();
-  return item.name;
-}
-
 bool Ui::gotCategorySelected() {
   const pkgListItem& item = getCurrentPkgListItem();
   return isCategory(item);
@@ -307,30 +467,47 @@ bool Ui::isCategory(const pkgListItem& item) const {
   return item.type == pkgListItemType::category;
 }
 
-void Ui::toggleCategoryFolding(const std::string& category) {
-  if (unfolded_.find(category) != unfolded_.end()) {
-    unfolded_[category] = unfolded_[category] == true ? false : true;
+// Unfolding a category inserts the rows of its ports right below it,
+// and folding it removes them, the rest of the list being left as is.
+void Ui::toggleCategoryFolding(int row) {
+  std::string_view category = pkgList_[row].name;
+  Pkg::CategoryId categoryId = pkgList_[row].category;
+  auto it = unfolded_.find(category);
+  if (it != unfolded_.end()) {
+    it->second = !it->second;
   } else {
-    unfolded_[category] = true;
+    it = unfolded_.emplace(category, true).first;
   }
-}
 
-void Ui::closeAllFolds() {
-  unfolded_.clear();
-  pane_[pkgList]->resetCursorPosition();
+  auto first = pkgList_.begin() + row + 1;
+  if (it->second) {
+    const std::vector<Pkg::PkgId>& ids = Pkg::instance().getPkgIds(categoryId);
+    first = pkgList_.insert(first, ids.size(), {pkgListItemType::pkg, std::string_view(), categoryId, 0});
+    for (const auto& id : ids) {
+      (first++)->id = id;
+    }
+    pane_[pkgList]->insertRows(row + 1, ids.size());
+  } else {
+    auto last = std::find_if(first, pkgList_.end(), [this](const pkgListItem& item) {
+        return isCategory(item);
+      });
+    pane_[pkgList]->removeRows(row + 1, last - first);
+    pkgList_.erase(first, last);
+  }
+  pane_[pkgList]->updateRow(row);
 }
 
 void Ui::registerPkgChange(Event::Type event) {
   if (!gotCategorySelected()) {
-    std::string origin = getSelectedItemName();
+    Pkg::PkgId id = getCurrentPkgListItem().id;
 
     switch (event) {
     case Event::Type::select:
-      Pkg::instance().registerInstall(origin);
+      Pkg::instance().registerInstall(id);
       break;
 
     case Event::Type::deselect:
-      Pkg::instance().registerRemoval(origin);
+      Pkg::instance().registerRemoval(id);
       break;
 
     default:
@@ -339,14 +516,29 @@ void Ui::registerPkgChange(Event::Type event) {
   }
 }
 
+// Pending actions are performed in the background while the status
+// line follows their progress. Errors reported by the backend are shown
+// once they are over, the last one being the most relevant.
 void Ui::performPending() {
-  busy_ = true;
-  std::thread uiHint([this]() {busyStatus(*pane_[pkgList]);});
-  uiHint.detach();
+  auto pending = std::async(std::launch::async, &Pkg::performPending, &Pkg::instance());
+  while (pending.wait_for(std::chrono::milliseconds(progressTickMs)) != std::future_status::ready) {
+    displayProgress();
+  }
 
-  std::thread pendingActions(&Pkg::performPending, &Pkg::instance());
-  pendingActions.join();
-  busy_ = false;
+  Progress::State state = Pkg::instance().getProgress().state();
+  std::string error = state.errors.empty() ? std::string() : state.errors.back();
+  try {
+    pending.get();
+    if (!error.empty()) {
+      gfx::PopupWindow(truncate(error), gfx::PopupWindow::Type::warning);
+    }
+  }
+  catch (std::exception& e) {
+    syslog(LOG_ERR, "%s", e.what());
+    gfx::PopupWindow(truncate(error.empty() ? "Transaction failed" : error),
+                     gfx::PopupWindow::Type::error);
+  }
+  updateStatus();
 }
 
 void Ui::promptFilter(int character) {
@@ -373,7 +565,8 @@ void Ui::displaySearchStatus() const {
   if (!searchString_.empty()) {
     gfx::Style style;
     style.color = gfx::Style::Color::cyan;
-    pane_[pkgList]->printStatus(searchString_, style);
+    pane_[pkgList]->printStatus(Pkg::instance().isSearching() ? searchString_ + " ..."
+                                                              : searchString_, style);
   }
 }
 
@@ -442,7 +635,11 @@ void Ui::updateStatus() const {
   pane_[pkgList]->clearStatus();
   switch (currentMode_) {
   case Mode::browse:
-    // DO NOTHING
+    if (Pkg::instance().isLoading()) {
+      gfx::Style style;
+      style.color = gfx::Style::Color::cyan;
+      pane_[pkgList]->printStatus("Loading packages...", style);
+    }
     break;
   case Mode::search:
     displaySearchStatus();
@@ -453,91 +650,136 @@ void Ui::updateStatus() const {
   }
 }
 
+// Only the ports affected by pending actions are refreshed once those
+// are performed, so the current mode's result set is computed again,
+// but categories folding and cursor position are preserved.
+void Ui::applyCurrentMode() {
+  Pkg::instance().cancelSearch();
+  searchRerun_ = false;
+  switch (currentMode_) {
+  case Mode::browse:
+    Pkg::instance().resetFilter();
+    break;
+  case Mode::search:
+    applySearch();
+    break;
+  case Mode::filter:
+    applyFilter();
+    break;
+  }
+}
+
 void Ui::applyFilter() const {
   Pkg::instance().applyFilter(filters_);
 }
 
-void Ui::promptSearch(int character) {
-  gfx::Point pos = gfx::Point::Label::center;
-  gfx::InputWindow inputWindow(pos, 40);
-  inputWindow.setContent(std::string(1, static_cast<char>(character)));
-  searchString_ = inputWindow.getInput();
+// The list follows the search string as it is typed: at once if its
+// results were cached, or else once they are found in the background,
+// syncPkgList() showing them, so that typing is never held up.
+void Ui::startSearch() {
+  bool found = true;
+  searchRerun_ = false;
+  if (searchString_.empty()) {
+    Pkg::instance().cancelSearch();
+    Pkg::instance().resetFilter();
+  } else {
+    found = Pkg::instance().startSearch(searchString_);
+  }
+
+  if (found) {
+    pane_[pkgList]->resetCursorPosition();
+    updatePanes();
+  }
+  updateStatus();
 }
 
-void Ui::applySearch() const {
-  if (!searchString_.empty()) {
-    Pkg::instance().search(searchString_);
-  }
-}
-
-void Ui::busyStatus(gfx::ScrollWindow& pane) {
-  pane.clearStatus();
-  gfx::Style busyStyle;
-  busyStyle.color = gfx::Style::Color::cyan;
-  busyStyle.reverse = true;
-  std::string busyString("     ");
-  int busyStringLen = busyString.length();
-  pane.printStatus(busyString);
-  for (;;) {
-    for (int x = 0; x < busyStringLen; ++x) {
-      if (!busy_) {
-        pane.clearStatus();
-        updateStatus();
-        display();
-        return;
-      } else {
-        pane.setStatusStyle(0, busyStringLen, {});
-        pane.setStatusStyle(x, 1, busyStyle);
-        pane.draw();
-        gfx::Gfx::instance().update();
-        std::this_thread::sleep_for(std::chrono::milliseconds(150));
-      }
-    }
+// The search is run again in the background as well, syncPkgList()
+// showing its results with the cursor kept on the same item.
+void Ui::applySearch() {
+  if (searchString_.empty()) {
+    Pkg::instance().resetFilter();
+  } else {
+    searchRerun_ = !Pkg::instance().startSearch(searchString_);
+  }
+}
+
+void Ui::displayProgress() const {
+  static const std::string stepName[] = {"Preparing", "Fetching", "Installing", "Removing"};
+
+  Progress::State state = Pkg::instance().getProgress().state();
+  std::string status = stepName[static_cast<int>(state.step)];
+  if (state.step == Progress::Step::idle && state.done > 0) {
+    status = "Refreshing";
   }
+  if (state.package.empty()) {
+    status.append("...");
+  } else {
+    status.append(" " + state.package);
+  }
+  if (state.total > 0) {
+    status.append(" (" + std::to_string(state.done) + "/" + std::to_string(state.total) + ")");
+  }
+  if (state.bytesTotal > 0) {
+    status.append(" " + formatSize(state.bytesFetched) + "/" + formatSize(state.bytesTotal));
+  }
+  if (state.eta >= 0) {
+    status.append(" ETA " + formatDuration(state.eta));
+  }
+
+  gfx::Style style;
+  style.color = gfx::Style::Color::cyan;
+  pane_[pkgList]->clearStatus();
+  pane_[pkgList]->printStatus(truncate(status), style);
+  pane_[pkgList]->draw();
+  gfx::Gfx::instance().update();
 }
 
-bool Ui::isCategoryFolded(const std::string& category) const {
-  return unfolded_.find(category) == unfolded_.end() || unfolded_.at(category) == false;
+bool Ui::isCategoryFolded(std::string_view category) const {
+  auto it = unfolded_.find(category);
+  return it == unfolded_.end() || it->second == false;
 }
 
-std::string Ui::getStringForCategory(const std::string& category) const {
+std::string Ui::getStringForCategory(const pkgListItem& item) const {
   std::string categoryString(markerCategory);
-  if (isCategoryFolded(category)) {
+  if (isCategoryFolded(item.name)) {
     categoryString.append(markerFolded);
   } else {
     categoryString.append(markerUnfolded);
   }
   categoryString.append(" ");
-  categoryString.append(category);
+  categoryString.append(item.name);
   categoryString.append(" (");
-  categoryString.append(std::to_string(Pkg::instance().getCategorySize(category)));
+  categoryString.append(std::to_string(Pkg::instance().getPkgIds(item.category).size()));
   categoryString.append(")");
 
   return categoryString;
 }
 
-std::string Ui::getStringForPkg(const std::string& origin) const {
-  std::string pkgString = Pkg::instance().getCurrentStatusAsString(origin);
-  if (Pkg::instance().hasPendingActions(origin)) {
+std::string Ui::getStringForPkg(Pkg::PkgId id) const {
+  std::string pkgString(Pkg::instance().getPkgAttrView(id, Pkg::Attr::status));
+  if (Pkg::instance().hasPendingActions(id)) {
     pkgString.append("[");
-    pkgString.append(Pkg::instance().getPendingStatusAsString(origin));
+    pkgString.append(Pkg::instance().getPendingStatusAsString(id));
     pkgString.append("] ");
-  } else if (Pkg::instance().isUpgradable(origin)) {
+  } else if (Pkg::instance().isUpgradable(id)) {
     pkgString.append("[^] ");
+  } else if (Pkg::instance().isDowngradable(id)) {
+    pkgString.append("[v] ");
   } else {
     pkgString.append("    ");
   }
-  pkgString.append(Pkg::instance().getNameFromOrigin(origin));
+  pkgString.append(Pkg::instance().getPkgAttrView(id, Pkg::Attr::name));
 
   return pkgString;
 }
 
-std::string Ui::getVersionsForPkg(const std::string& origin) const {
-  std::string pkgVersions = Pkg::instance().getLocalVersion(origin);
-  if (!pkgVersions.empty()) {
+std::string Ui::getVersionsForPkg(Pkg::PkgId id) const {
+  std::string pkgVersions(Pkg::instance().getPkgAttrView(id, Pkg::Attr::localVersion));
+  std::string_view remoteVersion = Pkg::instance().getPkgAttrView(id, Pkg::Attr::remoteVersion);
+  if (!pkgVersions.empty() && !remoteVersion.empty()) {
     pkgVersions.append("    ");
   }
-  pkgVersions.append(Pkg::instance().getRemoteVersion(origin));
+  pkgVersions.append(remoteVersion);
 
   return pkgVersions;
 }
@@ -28,6 +28,7 @@
 
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 
@@ -51,6 +52,8 @@ class Ui {
   Ui(const Ui&) = delete;
   void operator=(const Ui&) = delete;
 
+  friend class Benchmark;
+
   enum PaneType {
     pkgList,
     pkgDescr,
@@ -64,8 +67,10 @@ class Ui {
   };
 
   struct pkgListItem {
-    pkgListItemType type;
-    std::string     name;
+    pkgListItemType   type;
+    std::string_view  name;      // category name
+    Pkg::CategoryId   category;  // category identifier
+    Pkg::PkgId        id;        // package identifier
   };
 
   enum Mode {
@@ -79,39 +84,43 @@ class Ui {
   std::string                         modeName_[nbModes] {"Browse", "Search", "Filter"};
   std::string                         searchString_;
   Pkg::Status                         filters_;
-  bool                                busy_ {false};
   std::unique_ptr<gfx::ScrollWindow>  pane_[PaneType::nbtypes];
   std::unique_ptr<gfx::Tray>          tray_;
-  std::map<std::string, bool>         unfolded_;
+  std::map<std::string, bool, std::less<>>  unfolded_;
   std::vector<pkgListItem>            pkgList_;
   int                                 currentMode_ {Mode::browse};
+  bool                                descrLoading_ {false};
+  bool                                searchRerun_ {false};  // search run again as the list changed
 
   void                createInterface();
   void                updatePanes();
   void                buildPkgList();
   void                updatePkgListPane(const std::vector<std::string>& origins);
   void                updatePkgListPane();
+  void                getPkgListRow(int index, gfx::ScrollWindow::Row& row) const;
   void                updatePkgDescrPane();
+  void                displayDependencyImpact(Pkg::PkgId id);
+  void                prefetchDescriptions() const;
+  void                syncPkgList();
   const pkgListItem&  getCurrentPkgListItem() const;
-  std::string         getSelectedItemName() const;
   bool                gotCategorySelected();
   bool                isCategory(const pkgListItem& str) const;
-  void                toggleCategoryFolding(const std::string& category);
-  void                closeAllFolds();
+  void                toggleCategoryFolding(int row);
   void                registerPkgChange(Event::Type event);
   void                performPending();
   void                promptFilter(int character);
+  void                applyCurrentMode();
   void                applyFilter() const;
-  void                promptSearch(int character);
+  void                startSearch();
   void                displaySearchStatus() const;
   void                displayFilterStatus() const;
   void                updateStatus() const;
-  void                applySearch() const;
-  void                busyStatus(gfx::ScrollWindow& pane);
-  bool                isCategoryFolded(const std::string& category) const;
-  std::string         getStringForCategory(const std::string& category) const;
-  std::string         getStringForPkg(const std::string& origin) const;
-  std::string         getVersionsForPkg(const std::string& origin) const;
+  void                applySearch();
+  void                displayProgress() const;
+  bool                isCategoryFolded(std::string_view category) const;
+  std::string         getStringForCategory(const pkgListItem& item) const;
+  std::string         getStringForPkg(Pkg::PkgId id) const;
+  std::string         getVersionsForPkg(Pkg::PkgId id) const;
   void                selectNextMode();
   void                updateTray();
   void                showCurrentModeName();
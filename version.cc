@@ -0,0 +1,204 @@
+/*-
+ * Copyright (c) 2016 Frederic Culot <culot@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <strings.h>
+#include <cctype>
+#include <cstring>
+#include <algorithm>
+
+#include "version.h"
+
+namespace portal {
+
+// Keys hold the epoch and the revision first, followed by one key per
+// component of the port version, and by a separator between blocks.
+// A component is packed as its number, offset by two as it can be -1
+// when missing or -2 for '*', then its letters and its patch level,
+// offset by one as it is -1 when letters are not followed by a number.
+static const Version::Key blockSeparator = UINT64_MAX;
+static const size_t epochKey = 0;
+static const size_t revisionKey = 1;
+static const size_t firstComponentKey = 2;
+
+static Version::Key packComponent(long number, unsigned int letters, long patchLevel) {
+  const unsigned long maxNumber = 0xfffffffdUL;
+  const unsigned long maxPatchLevel = 0xfffffeUL;
+  Version::Key key = number < 0 ? 2 + number : std::min<unsigned long>(number, maxNumber) + 2;
+  Version::Key level = patchLevel < 0 ? 0 : std::min<unsigned long>(patchLevel, maxPatchLevel) + 1;
+  return key << 32 | letters << 24 | level;
+}
+
+// Key used for a missing component, which compares as "0"
+static const Version::Key missingComponent = packComponent(0, 0, 0);
+
+// Letter strings with a special meaning, "pl" standing for a patch level
+// and the others for pre-releases, which sort as their initial.
+static const struct {
+  const char*   name;
+  size_t        len;
+  unsigned int  value;
+} specialLetters[] = {
+  {"pl", 2, 0},
+  {"alpha", 5, 'a' - 'a' + 1},
+  {"beta", 4, 'b' - 'a' + 1},
+  {"pre", 3, 'p' - 'a' + 1},
+  {"rc", 2, 'r' - 'a' + 1}
+};
+
+static unsigned long parseNumber(const char*& pos, const char* end) {
+  unsigned long number = 0;
+  for (; pos < end && isdigit(static_cast<unsigned char>(*pos)); ++pos) {
+    number = number > 0xffffffffUL ? number : number * 10 + (*pos - '0');
+  }
+
+  return number;
+}
+
+// Parse the component starting at pos, and move past it and the dots
+// which follow it. As in pkg(8), a special string following a number
+// starts the next component, whose number is then missing: this makes
+// "1.0rc1", parsed as "1.0.rc1", sort before "1.0". Other letters belong
+// to the component of the number, so that "1.0a" sorts after "1.0", and
+// only have a patch level when they start the component.
+static Version::Key parseComponent(const char*& pos, const char* end) {
+  const char* start = pos;
+
+  long number = -1;
+  if (isdigit(static_cast<unsigned char>(*pos))) {
+    number = parseNumber(pos, end);
+  } else if (*pos == '*') {
+    number = -2;
+    while (pos < end && *pos != '+') {
+      ++pos;
+    }
+  }
+
+  unsigned int letters = 0;
+  long patchLevel = 0;
+  if (pos < end && isalpha(static_cast<unsigned char>(*pos))) {
+    bool special = false;
+    for (const auto& string : specialLetters) {
+      if (static_cast<size_t>(end - pos) >= string.len
+          && strncasecmp(pos, string.name, string.len) == 0
+          && (pos + string.len == end || !isalpha(static_cast<unsigned char>(pos[string.len])))) {
+        if (number == -1) {
+          letters = string.value;
+          pos += string.len;
+        }
+        special = true;
+        break;
+      }
+    }
+    if (!special) {
+      letters = tolower(static_cast<unsigned char>(*pos)) - 'a' + 1;
+      while (pos < end && isalpha(static_cast<unsigned char>(*pos))) {
+        ++pos;
+      }
+    }
+  }
+  if (number == -1) {
+    patchLevel = -1;
+    if (pos < end && isdigit(static_cast<unsigned char>(*pos))) {
+      patchLevel = parseNumber(pos, end);
+    }
+  }
+
+  if (pos == start) {
+    ++pos;
+  }
+  while (pos < end && !isalnum(static_cast<unsigned char>(*pos)) && *pos != '+' && *pos != '*') {
+    ++pos;
+  }
+
+  return packComponent(number, letters, patchLevel);
+}
+
+void Version::decompose(const char* version, size_t len, std::vector<Key>& keys) {
+  const char* end = version + len;
+
+  const char* underscore = static_cast<const char*>(memrchr(version, '_', len));
+  const char* epochStart = underscore != nullptr ? underscore + 1 : version;
+  const char* comma = static_cast<const char*>(memrchr(epochStart, ',', end - epochStart));
+
+  const char* pos = comma != nullptr ? comma + 1 : end;
+  keys.push_back(parseNumber(pos, end));
+  pos = underscore != nullptr ? underscore + 1 : end;
+  keys.push_back(parseNumber(pos, end));
+
+  const char* versionEnd = underscore != nullptr ? underscore : (comma != nullptr ? comma : end);
+  for (pos = version; pos < versionEnd;) {
+    if (*pos == '+') {
+      keys.push_back(blockSeparator);
+      ++pos;
+    } else {
+      keys.push_back(parseComponent(pos, versionEnd));
+    }
+  }
+}
+
+// Compare the epochs, then the port versions block by block, missing
+// components or blocks comparing as zero, and finally the revisions.
+int Version::compare(const Key* lhs, size_t lhsLen, const Key* rhs, size_t rhsLen) {
+  if (lhs[epochKey] != rhs[epochKey]) {
+    return lhs[epochKey] < rhs[epochKey] ? -1 : 1;
+  }
+
+  size_t i = firstComponentKey;
+  size_t j = firstComponentKey;
+  while (i < lhsLen || j < rhsLen) {
+    bool lhsBlocked = i >= lhsLen || lhs[i] == blockSeparator;
+    bool rhsBlocked = j >= rhsLen || rhs[j] == blockSeparator;
+    if (lhsBlocked && rhsBlocked) {
+      ++i;
+      ++j;
+      continue;
+    }
+
+    Key lhsKey = lhsBlocked ? missingComponent : lhs[i];
+    Key rhsKey = rhsBlocked ? missingComponent : rhs[j];
+    if (lhsKey != rhsKey) {
+      return lhsKey < rhsKey ? -1 : 1;
+    }
+    i += lhsBlocked ? 0 : 1;
+    j += rhsBlocked ? 0 : 1;
+  }
+
+  if (lhs[revisionKey] != rhs[revisionKey]) {
+    return lhs[revisionKey] < rhs[revisionKey] ? -1 : 1;
+  }
+
+  return 0;
+}
+
+int Version::compare(const std::string& lhs, const std::string& rhs) {
+  std::vector<Key> lhsKeys, rhsKeys;
+  decompose(lhs.data(), lhs.length(), lhsKeys);
+  decompose(rhs.data(), rhs.length(), rhsKeys);
+
+  return compare(lhsKeys.data(), lhsKeys.size(), rhsKeys.data(), rhsKeys.size());
+}
+
+}
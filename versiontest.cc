@@ -0,0 +1,101 @@
+/*-
+ * Copyright (c) 2016 Frederic Culot <culot@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstdio>
+#include <string>
+
+#include "version.h"
+
+// Checks of the ordering of versions, whose expected results are the
+// ones of pkg-version(8) -t.
+
+namespace {
+
+struct Case {
+  const char*  lhs;
+  const char*  rhs;
+  int          expected;
+};
+
+const Case cases[] = {
+  {"1.0", "1.0", 0},
+  {"1.0", "1.0.0", 0},
+  {"1.10", "1.9", 1},
+  {"1.0.1", "1.0", 1},
+  // Pre-releases sort before the release, in the order of their initial
+  {"1.0rc1", "1.0", -1},
+  {"1.0alpha1", "1.0", -1},
+  {"1.0.b1", "1.0", -1},
+  {"1.0alpha1", "1.0beta1", -1},
+  {"1.0beta1", "1.0pre1", -1},
+  {"1.0pre1", "1.0rc1", -1},
+  {"1.0rc1", "1.0rc2", -1},
+  {"1.0a", "1.0a1", -1},
+  {"1.0rc1", "0.9", 1},
+  // Other letters belong to the number they follow
+  {"1.0a", "1.0", 1},
+  {"1.0a", "1.0.1", 1},
+  {"1.1.1w", "1.1.1", 1},
+  {"1.0b1", "1.0", 1},
+  {"1.0b1", "1.0.b1", 1},
+  {"1.0a", "1.0b", -1},
+  // "pl" is a patch level, which sorts before any letter
+  {"1.0pl1", "1.0alpha1", -1},
+  {"1.0pl1", "1.0pl2", -1},
+  {"1.0pl1", "1.0", -1},
+  // The epoch prevails over the version, and the revision comes last
+  {"1.0,1", "2.0", 1},
+  {"2.0,1", "1.0,1", 1},
+  {"1.0_1", "1.0", 1},
+  {"1.0_2", "1.0_1", 1},
+  {"1.0_9", "1.1", -1},
+  {"1.0_1,1", "1.0,1", 1},
+  {"1.0rc1_1", "1.0", -1},
+  // Pluses separate blocks, compared in turn
+  {"1.0+2", "1.0+10", -1},
+  {"1.0+1", "1.0", 1},
+};
+
+}
+
+int main() {
+  int failures = 0;
+  for (const auto& test : cases) {
+    for (int sign : {1, -1}) {
+      std::string lhs = sign > 0 ? test.lhs : test.rhs;
+      std::string rhs = sign > 0 ? test.rhs : test.lhs;
+      int result = portal::Version::compare(lhs, rhs);
+      if (result != sign * test.expected) {
+        printf("compare(\"%s\", \"%s\"): got %d, expected %d\n",
+               lhs.c_str(), rhs.c_str(), result, sign * test.expected);
+        ++failures;
+      }
+    }
+  }
+  printf("%zu cases, %d failed\n", 2 * sizeof(cases) / sizeof(cases[0]), failures);
+
+  return failures == 0 ? 0 : 1;
+}
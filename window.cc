@@ -40,6 +40,8 @@ class Window::Impl {
   Size  size;
   Point pos, posStatus;
   Style style;
+  mutable bool damaged {true};
+  mutable unsigned int generation {0};
 
   // XXX Add a Point posCursor to allow for text spanning multi lines
 
@@ -76,6 +78,7 @@ void Window::setSize(const Size& size) {
   if (impl_->size != size) {
     impl_->size = size;
     impl_->resize();
+    damage();
   }
 }
 
@@ -83,12 +86,14 @@ void Window::setPosition(const Point& pos) {
   if (impl_->pos != pos) {
     impl_->pos = pos;
     impl_->move();
+    damage();
   }
 }
 
 void Window::setStyle(const Style& style) {
   impl_->style = style;
   impl_->drawBorders();
+  damage();
 }
 
 Size Window::size() const {
@@ -112,7 +117,7 @@ void Window::print(const std::string& msg, const Style& style) {
   if (impl_->style.color != Style::Color::none) {
     wattroff(impl_->win, COLOR_PAIR(impl_->style.color));
   }
-  wnoutrefresh(impl_->win);
+  damage();
 }
 
 void Window::print(int c, const Point& pos, const Style& style) const {
@@ -124,7 +129,7 @@ void Window::print(int c, const Point& pos, const Style& style) const {
   }
   waddch(impl_->win, c);
   wattroff(impl_->win, COLOR_PAIR(color));
-  wnoutrefresh(impl_->win);
+  damage();
 }
 
 void Window::printStatus(const std::string& status, const Style& style) const {
@@ -141,7 +146,7 @@ void Window::printStatus(const std::string& status, const Style& style) const {
   xpos += statusLength;
   mvwaddch(impl_->win, ypos, xpos++, ' ');
   mvwaddch(impl_->win, ypos, xpos, ACS_LTEE);
-  wnoutrefresh(impl_->win);
+  damage();
 }
 
 void Window::setStatusStyle(int xpos, int len, const Style& style) const {
@@ -152,22 +157,44 @@ void Window::setStatusStyle(int xpos, int len, const Style& style) const {
            style.cursesAttrs(),
            style.color,
            nullptr);
-  wnoutrefresh(impl_->win);
+  damage();
 }
 
 void Window::clearStatus() const {
   impl_->posStatus.reset();
   impl_->drawBorders();
+  damage();
 }
 
 void Window::draw() const {
-  impl_->draw();
+  if (isOverwritten()) {
+    touchwin(impl_->win);
+  }
+  if (isDamaged()) {
+    impl_->draw();
+    impl_->damaged = false;
+    impl_->generation = Gfx::instance().generation();
+  }
 }
 
 void Window::clear() {
   werase(impl_->win);
   wmove(impl_->win, 0, 0);
-  impl_->draw();
+  damage();
+}
+
+void Window::damage() const {
+  impl_->damaged = true;
+}
+
+bool Window::isDamaged() const {
+  return impl_->damaged || isOverwritten();
+}
+
+// Windows are all damaged at once by Gfx::damage(), and must then be
+// copied whole to the virtual screen, not only their changed lines
+bool Window::isOverwritten() const {
+  return impl_->generation != Gfx::instance().generation();
 }
 
 bool Window::Impl::initialized() const {
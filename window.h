@@ -59,6 +59,14 @@ class Window {
   virtual void   draw() const;
   virtual void   clear();
 
+ protected:
+  // Printing only marks the window as damaged, and draw() composes it
+  // into the virtual screen if it is, the terminal being updated once
+  // per frame by Gfx::update().
+  void           damage() const;
+  bool           isDamaged() const;
+  bool           isOverwritten() const;
+
  private:
   class Impl;
   std::unique_ptr<Impl> impl_;